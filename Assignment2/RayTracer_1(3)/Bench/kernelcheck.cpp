@@ -0,0 +1,493 @@
+// Consistency check of the intersection kernels.
+//
+// Compares the triangle batch kernel and the sphere and triangle packet
+// kernels of every instruction set the build and the cpu support with the
+// reference code of the shapes, TriangleGeometry::intersect and
+// SphereGeometry::intersect. Per ray the kernels must agree on whether it
+// hits and, if it does, give exactly the same distance, index of the
+// closest triangle and barycentric coordinates. Besides random triangles
+// and rays it tests degenerate triangles (zero area, repeated corners, far
+// too small or large), duplicated triangles, rays in the plane of a
+// triangle (edge-on), rays through its corners and edges, rays starting on
+// a surface, and spheres that are only touched or have no radius.
+//
+// Prints the number of checks per kernel and the first mismatches, and
+// exits with 1 if there are any. Run it after changing a kernel, in both
+// precisions (see real.h).
+//
+// Usage: kernelcheck [rays] [seed]     # default: 20000 1
+
+#include "kernels.h"
+#include "packet.h"
+#include "simd.h"
+#include "shapes/sphere.h"
+#include "shapes/triangle.h"
+
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    real const INF = numeric_limits<real>::infinity();
+
+    struct Level
+    {
+        char const *name;
+        Kernels const *kernels;
+    };
+
+    // The triangles as TriangleGeometry and as the arrays of a
+    // TriangleBuffer
+    struct TriangleSet
+    {
+        vector<TriangleGeometry> geometry;
+        vector<real> v0[3];
+        vector<real> e1[3];
+        vector<real> e2[3];
+
+        void add(Point const &p0, Point const &p1, Point const &p2)
+        {
+            geometry.emplace_back(p0, p1, p2);
+            Vector const edge1 = p1 - p0;
+            Vector const edge2 = p2 - p0;
+            for (unsigned axis = 0; axis != 3; ++axis)
+            {
+                v0[axis].push_back(p0.data[axis]);
+                e1[axis].push_back(edge1.data[axis]);
+                e2[axis].push_back(edge2.data[axis]);
+            }
+        }
+
+        TriangleArrays arrays() const
+        {
+            return TriangleArrays{
+                { v0[0].data(), v0[1].data(), v0[2].data() },
+                { e1[0].data(), e1[1].data(), e1[2].data() },
+                { e2[0].data(), e2[1].data(), e2[2].data() } };
+        }
+
+        size_t size() const
+        {
+            return geometry.size();
+        }
+    };
+
+    class Checker
+    {
+        mt19937 d_random;
+        unsigned long long d_checks = 0;
+        unsigned long long d_mismatches = 0;
+
+        public:
+            explicit Checker(unsigned seed)
+            :
+                d_random(seed)
+            {}
+
+            double uniform(double low, double high)
+            {
+                return uniform_real_distribution<double>(low, high)(
+                    d_random);
+            }
+
+            unsigned index(size_t count)
+            {
+                return uniform_int_distribution<size_t>(0, count - 1)(
+                    d_random);
+            }
+
+            Point point(double range)
+            {
+                return Point(uniform(-range, range), uniform(-range, range),
+                             uniform(-range, range));
+            }
+
+            // Counts a check, reports it if it failed
+            void check(bool ok, string const &what)
+            {
+                ++d_checks;
+                if (ok)
+                    return;
+                if (d_mismatches < 10)
+                    cout << "  mismatch: " << what << '\n';
+                ++d_mismatches;
+            }
+
+            unsigned long long checks() const
+            {
+                return d_checks;
+            }
+
+            unsigned long long mismatches() const
+            {
+                return d_mismatches;
+            }
+    };
+
+    string describe(Ray const &ray)
+    {
+        ostringstream out;
+        out << setprecision(17) << "ray (" << ray.O.x << ", " << ray.O.y
+            << ", " << ray.O.z << ") + t (" << ray.D.x << ", " << ray.D.y
+            << ", " << ray.D.z << ")";
+        return out.str();
+    }
+
+    TriangleSet makeTriangles(Checker &checker)
+    {
+        TriangleSet tris;
+
+        // random triangles of all sizes
+        for (unsigned idx = 0; idx != 40; ++idx)
+        {
+            Point const p0 = checker.point(1.0);
+            double const size = pow(10.0, checker.uniform(-3, 0.5));
+            tris.add(p0, p0 + size * checker.point(1.0),
+                     p0 + size * checker.point(1.0));
+        }
+
+        // degenerate ones: a line, repeated corners, a point
+        Point const p0 = checker.point(1.0);
+        Point const p1 = checker.point(1.0);
+        tris.add(p0, p1, p0 + 2.0 * (p1 - p0));
+        tris.add(p0, p0, p1);
+        tris.add(p0, p1, p1);
+        tris.add(p0, p0, p0);
+
+        // too small and far too large to test reliably
+        tris.add(p1, p1 + Vector(1e-5, 0, 0), p1 + Vector(0, 1e-5, 0));
+        tris.add(Point(-1e4, -1e4, 0.3), Point(1e4, -1e4, 0.3),
+                 Point(0, 1e4, 0.3));
+
+        // an axis aligned square, as two triangles sharing a diagonal
+        tris.add(Point(-0.5, -0.5, -0.2), Point(0.5, -0.5, -0.2),
+                 Point(0.5, 0.5, -0.2));
+        tris.add(Point(-0.5, -0.5, -0.2), Point(0.5, 0.5, -0.2),
+                 Point(-0.5, 0.5, -0.2));
+
+        // the same triangle twice: ties in distance
+        for (unsigned copy = 0; copy != 2; ++copy)
+            tris.add(tris.geometry[3].v0, tris.geometry[3].v1,
+                     tris.geometry[3].v2);
+        return tris;
+    }
+
+    // A ray aimed at a triangle of the set, or a random one
+    Ray makeRay(Checker &checker, TriangleSet const &tris)
+    {
+        TriangleGeometry const &tri = tris.geometry[checker.index(
+                                                        tris.size())];
+        Vector const e1 = tri.v1 - tri.v0;
+        Vector const e2 = tri.v2 - tri.v0;
+
+        // barycentric coordinates of the target: inside, on a corner, on
+        // an edge or just outside
+        double u = checker.uniform(0, 1);
+        double v = checker.uniform(0, 1 - u);
+        switch (checker.index(8))
+        {
+            case 0:                 // corners
+                u = checker.index(2);
+                v = u == 0 ? checker.index(2) : 0;
+                break;
+            case 1:                 // edges
+                v = 0;
+                break;
+            case 2:
+                u = 0;
+                break;
+            case 3:
+                v = 1 - u;
+                break;
+            case 4:                 // outside
+                u += 1e-3;
+                v = 1 - u + 1e-3;
+                break;
+        }
+        Point const target = tri.v0 + u * e1 + v * e2;
+
+        Point origin = checker.point(3.0);
+        Vector direction = target - origin;
+        switch (checker.index(8))
+        {
+            case 0:                 // edge-on: in the plane of the triangle
+                origin = tri.v0 + checker.uniform(-2, 2) * e1
+                                + checker.uniform(-2, 2) * e2;
+                direction = target - origin;
+                break;
+            case 1:                 // starting on the triangle
+                origin = target;
+                direction = checker.point(1.0);
+                break;
+            case 2:                 // random, mostly missing
+                direction = checker.point(1.0);
+                break;
+        }
+
+        // primary and secondary rays have unit directions, the rays of a
+        // mesh instance in model space need not
+        if (checker.index(2) == 0)
+            direction.normalize();
+        return Ray(origin, direction);
+    }
+
+    // Closest hit of the triangles [first, first + count) closer than tMax,
+    // with TriangleGeometry::intersect
+    bool referenceHit(TriangleSet const &tris, Ray const &ray,
+                      unsigned first, unsigned count, real &tMax,
+                      unsigned &hitTri, real &hitU, real &hitV)
+    {
+        bool found = false;
+        for (unsigned tri = first; tri != first + count; ++tri)
+        {
+            Hit const hit = tris.geometry[tri].intersect(ray);
+            if (real(hit.t) < tMax)
+            {
+                tMax = hit.t;
+                hitTri = tri;
+                hitU = hit.u;
+                hitV = hit.v;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    void checkTriangles(Checker &checker, Level const &level,
+                        TriangleSet const &tris, vector<Ray> const &rays)
+    {
+        TriangleArrays const arrays = tris.arrays();
+        for (Ray const &ray : rays)
+        {
+            // all triangles and a random range, with and without a limit
+            unsigned const first = checker.index(tris.size());
+            unsigned const count = 1 + checker.index(tris.size() - first);
+            for (unsigned range = 0; range != 4; ++range)
+            {
+                unsigned const from = range < 2 ? 0 : first;
+                unsigned const num = range < 2 ? tris.size() : count;
+                real const limit = range % 2 == 0 ? INF
+                                                  : checker.uniform(0, 4);
+
+                real refT = limit;
+                unsigned refTri = ~0U;
+                real refU = -1;
+                real refV = -1;
+                bool const refFound = referenceHit(tris, ray, from, num,
+                                                   refT, refTri, refU, refV);
+
+                real t = limit;
+                unsigned tri = ~0U;
+                real u = -1;
+                real v = -1;
+                bool const found = level.kernels->intersectTriangles(
+                    ray.O.data, ray.D.data, arrays, from, num, t, tri, u, v);
+
+                bool const ok = found == refFound && t == refT
+                                && (!found || (tri == refTri && u == refU
+                                               && v == refV));
+                ostringstream what;
+                what << setprecision(9) << level.name
+                     << " intersectTriangles [" << from << ", "
+                     << from + num << "), " << describe(ray) << ": t " << t
+                     << " tri " << tri << " u " << u << " v " << v
+                     << ", expected t " << refT << " tri " << refTri
+                     << " u " << refU << " v " << refV;
+                checker.check(ok, what.str());
+            }
+        }
+    }
+
+    void checkTrianglePackets(Checker &checker, Level const &level,
+                              TriangleSet const &tris,
+                              vector<Ray> const &rays)
+    {
+        for (size_t idx = 0; idx + RayPacket::SIZE <= rays.size();
+             idx += RayPacket::SIZE)
+        {
+            RayPacket packet;
+            for (unsigned lane = 0; lane != RayPacket::SIZE; ++lane)
+                packet.set(lane, rays[idx + lane]);
+            unsigned const mask = 1 + checker.index(RayPacket::ALL);
+
+            for (TriangleGeometry const &tri : tris.geometry)
+            {
+                Vector const e1 = tri.v1 - tri.v0;
+                Vector const e2 = tri.v2 - tri.v0;
+                real t[RayPacket::SIZE];
+                real u[RayPacket::SIZE];
+                real v[RayPacket::SIZE];
+                unsigned const hitMask =
+                    level.kernels->intersectTrianglePacket(
+                        packet.O, packet.D, tri.v0.data, e1.data, e2.data,
+                        mask, t, u, v);
+
+                for (unsigned lane = 0; lane != RayPacket::SIZE; ++lane)
+                {
+                    Ray const ray = packet.ray(lane);
+                    Hit const ref = tri.intersect(ray);
+                    bool const refHit = (mask >> lane & 1)
+                                        && real(ref.t) < INF;
+                    bool const hit = hitMask >> lane & 1;
+                    bool const ok = hit == refHit
+                                    && (!hit || (t[lane] == real(ref.t)
+                                                 && u[lane] == real(ref.u)
+                                                 && v[lane] == real(ref.v)));
+                    ostringstream what;
+                    what << setprecision(9) << level.name
+                         << " intersectTrianglePacket lane " << lane << ", "
+                         << describe(ray) << ": "
+                         << (hit ? "hit" : "miss") << " t " << t[lane]
+                         << ", expected " << (refHit ? "hit" : "miss")
+                         << " t " << ref.t;
+                    checker.check(ok, what.str());
+                }
+            }
+        }
+    }
+
+    void checkSpherePackets(Checker &checker, Level const &level,
+                            vector<Ray> const &rays)
+    {
+        vector<SphereGeometry> spheres;
+        for (unsigned idx = 0; idx != 16; ++idx)
+            spheres.push_back(SphereGeometry{ checker.point(1.0),
+                                              real(checker.uniform(0.01,
+                                                                   1)) });
+        spheres.push_back(SphereGeometry{ checker.point(1.0), 0 });
+
+        for (size_t idx = 0; idx + RayPacket::SIZE <= rays.size();
+             idx += RayPacket::SIZE)
+        {
+            SphereGeometry const &sphere = spheres[checker.index(
+                                                       spheres.size())];
+
+            // rays from the surface, from inside and touching the sphere
+            RayPacket packet;
+            for (unsigned lane = 0; lane != RayPacket::SIZE; ++lane)
+            {
+                Ray ray = rays[idx + lane];
+                Vector const out = checker.point(1.0).normalized();
+                switch (checker.index(6))
+                {
+                    case 0:
+                        ray.O = sphere.position + sphere.r * out;
+                        break;
+                    case 1:
+                        ray.O = sphere.position + 0.5 * sphere.r * out;
+                        break;
+                    case 2:
+                        ray.D = out.cross(checker.point(1.0)).normalized();
+                        ray.O = sphere.position + sphere.r * out
+                                - 2.0 * ray.D;
+                        break;
+                }
+                packet.set(lane, ray);
+            }
+            unsigned const mask = 1 + checker.index(RayPacket::ALL);
+
+            real t[RayPacket::SIZE];
+            unsigned const hitMask = level.kernels->intersectSpherePacket(
+                packet.O, packet.D, sphere.position.data, sphere.r, mask, t);
+
+            for (unsigned lane = 0; lane != RayPacket::SIZE; ++lane)
+            {
+                Ray const ray = packet.ray(lane);
+                Hit const ref = sphere.intersect(ray);
+                bool const refHit = (mask >> lane & 1) && real(ref.t) < INF;
+                bool const hit = hitMask >> lane & 1;
+                bool const ok = hit == refHit
+                                && (!hit || t[lane] == real(ref.t));
+                ostringstream what;
+                what << setprecision(9) << level.name
+                     << " intersectSpherePacket lane " << lane << ", "
+                     << describe(ray) << ": " << (hit ? "hit" : "miss")
+                     << " t " << t[lane] << ", expected "
+                     << (refHit ? "hit" : "miss") << " t " << ref.t;
+                checker.check(ok, what.str());
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+try
+{
+    size_t numRays = argc > 1 ? stoul(argv[1]) : 20000;
+    unsigned seed = argc > 2 ? stoul(argv[2]) : 1;
+
+    // only the levels the cpu can run
+    Level const all[] =
+    {
+        { simdLevelName(SimdLevel::SCALAR), scalarKernels() },
+        { simdLevelName(SimdLevel::SSE2), sse2Kernels() },
+        { simdLevelName(SimdLevel::AVX2), avx2Kernels() }
+    };
+    vector<Level> levels;
+    for (unsigned level = 0;
+         level <= static_cast<unsigned>(detectSimdLevel()); ++level)
+        if (all[level].kernels != nullptr)
+            levels.push_back(all[level]);
+
+    Checker checker(seed);
+    TriangleSet const tris = makeTriangles(checker);
+    vector<Ray> rays;
+    rays.reserve(numRays);
+    for (size_t idx = 0; idx != numRays; ++idx)
+        rays.push_back(makeRay(checker, tris));
+
+    cout << "Kernel check: " << numRays << " rays, " << tris.size()
+         << " triangles, " << sizeof(real) * 8 << "-bit reals\n";
+
+    for (Level const &level : levels)
+    {
+        struct
+        {
+            char const *name;
+            void (*run)(Checker &, Level const &, TriangleSet const &,
+                        vector<Ray> const &);
+        } const kernelChecks[] =
+        {
+            { "intersectTriangles", checkTriangles },
+            { "intersectTrianglePacket", checkTrianglePackets },
+            { "intersectSpherePacket",
+              [](Checker &checker, Level const &level, TriangleSet const &,
+                 vector<Ray> const &rays)
+              {
+                  checkSpherePackets(checker, level, rays);
+              } }
+        };
+
+        for (auto const &kernelCheck : kernelChecks)
+        {
+            unsigned long long const checks = checker.checks();
+            unsigned long long const mismatches = checker.mismatches();
+            kernelCheck.run(checker, level, tris, rays);
+            cout << left << setw(8) << level.name << setw(26)
+                 << kernelCheck.name << right << setw(10)
+                 << checker.checks() - checks << " checks, "
+                 << checker.mismatches() - mismatches << " mismatches\n";
+        }
+    }
+
+    if (checker.mismatches() != 0)
+    {
+        cout << "FAILED: " << checker.mismatches() << " mismatches.\n";
+        return 1;
+    }
+    cout << "All kernels agree with the reference.\n";
+    return 0;
+}
+catch (exception const &ex)
+{
+    cerr << "Error: " << ex.what() << '\n';
+    return 1;
+}
@@ -0,0 +1,218 @@
+// Load-time benchmark for OBJLoader.
+//
+// Builds a large model by repeating an OBJ file (models/goat.obj by default)
+// a number of times, then loads it several times and reports the parse
+// throughput. The checksum of vertex_data() is printed so the output of
+// different parser versions can be compared.
+//
+// Afterwards the binary mesh cache (see meshcache.h) of the model is written
+// and loaded the same number of times, its vertex data must have the same
+// checksum.
+//
+// Usage: objbench [model.obj] [copies] [runs]
+
+#include "meshcache.h"
+#include "objloader.h"
+#include "vertex.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    // Offsets every index of a face element ("v/vt/vn", parts may be
+    // empty). Negative indices are relative and stay as they are.
+    string offsetElement(string const &element, size_t const offsets[3])
+    {
+        string result;
+        size_t part = 0;
+        size_t begin = 0;
+        while (true)
+        {
+            size_t end = element.find('/', begin);
+            string index = element.substr(begin, end - begin);
+            if (!index.empty() && index[0] != '-')
+                index = to_string(stoul(index) + offsets[part]);
+            result += index;
+            if (end == string::npos)
+                return result;
+            result += '/';
+            begin = end + 1;
+            ++part;
+        }
+    }
+
+    // Writes copies of the model to ofname, returns the file size
+    size_t writeScaledModel(string const &ifname, string const &ofname,
+                            unsigned copies)
+    {
+        ifstream in(ifname);
+        if (!in)
+            throw runtime_error("cannot open " + ifname);
+
+        vector<string> lines;
+        size_t counts[3] = {};          // v, vt and vn lines in one copy
+        for (string line; getline(in, line); )
+        {
+            if (line.compare(0, 2, "v ") == 0)
+                ++counts[0];
+            else if (line.compare(0, 3, "vt ") == 0)
+                ++counts[1];
+            else if (line.compare(0, 3, "vn ") == 0)
+                ++counts[2];
+            lines.push_back(line);
+        }
+
+        ofstream out(ofname);
+        for (unsigned copy = 0; copy != copies; ++copy)
+        {
+            size_t const offsets[3] = { copy * counts[0], copy * counts[1],
+                                        copy * counts[2] };
+            for (string const &line : lines)
+            {
+                if (line.compare(0, 2, "f ") != 0)
+                {
+                    out << line << '\n';
+                    continue;
+                }
+
+                istringstream elements(line.substr(2));
+                out << 'f';
+                for (string element; elements >> element; )
+                    out << ' ' << offsetElement(element, offsets);
+                out << '\n';
+            }
+        }
+        out.close();
+        return filesystem::file_size(ofname);
+    }
+
+    // FNV-1a over the raw bytes of the vertex data
+    uint64_t checksum(vector<Vertex> const &vertices)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (Vertex const &vertex : vertices)
+        {
+            unsigned char bytes[sizeof(Vertex)];
+            memcpy(bytes, &vertex, sizeof(Vertex));
+            for (unsigned char byte : bytes)
+                hash = (hash ^ byte) * 1099511628211ULL;
+        }
+        return hash;
+    }
+}
+
+int main(int argc, char *argv[])
+try
+{
+    string model = argc > 1 ? argv[1] : "../models/goat.obj";
+    unsigned copies = argc > 2 ? stoul(argv[2]) : 500;
+    unsigned runs = argc > 3 ? stoul(argv[3]) : 5;
+
+    string scaled = (filesystem::temp_directory_path() / "objbench.obj")
+                        .string();
+    size_t bytes = writeScaledModel(model, scaled, copies);
+    cout << "Model: " << model << " x " << copies << " = "
+         << bytes / 1e6 << " MB\n";
+
+    double best = 1e300;
+    double total = 0;
+    unsigned triangles = 0;
+    uint64_t hash = 0;
+    for (unsigned run = 0; run != runs; ++run)
+    {
+        auto start = chrono::steady_clock::now();
+        OBJLoader loader(scaled);
+        vector<Vertex> vertices = loader.vertex_data();
+        double seconds = chrono::duration<double>(
+                            chrono::steady_clock::now() - start).count();
+
+        best = min(best, seconds);
+        total += seconds;
+        triangles = loader.numTriangles();
+        hash = checksum(vertices);
+    }
+
+    cout << "Triangles: " << triangles << '\n'
+         << "Load time: best " << best * 1e3 << " ms, mean "
+         << total / runs * 1e3 << " ms over " << runs << " runs\n"
+         << "Throughput: " << bytes / best / 1e6 << " MB/s, "
+         << triangles / best / 1e6 << " M triangles/s\n"
+         << "Checksum of vertex_data(): " << hex << hash << dec << '\n';
+
+    {
+        OBJLoader loader(scaled);
+        vector<Vertex> vertices;
+        vector<unsigned> indices;
+        loader.indexed_data(vertices, indices);
+        if (!MeshCache::write(scaled, vertices, indices,
+                              loader.hasTexCoords()))
+            throw runtime_error("cannot write the mesh cache");
+    }
+
+    best = 1e300;
+    total = 0;
+    for (unsigned run = 0; run != runs; ++run)
+    {
+        auto start = chrono::steady_clock::now();
+        MeshCache cache(scaled);
+        if (!cache.valid())
+            throw runtime_error("the mesh cache is not valid");
+
+        // Expand to the layout of vertex_data() for the checksum
+        float const *positions = cache.positions();
+        float const *normals = cache.normals();
+        float const *texCoords = cache.texCoords();
+        uint32_t const *indices = cache.indices();
+        vector<Vertex> vertices;
+        vertices.reserve(3 * cache.numTriangles());
+        for (unsigned idx = 0; idx != 3 * cache.numTriangles(); ++idx)
+        {
+            uint32_t const vtx = indices[idx];
+            Vertex vertex {};
+            vertex.x = positions[3 * vtx];
+            vertex.y = positions[3 * vtx + 1];
+            vertex.z = positions[3 * vtx + 2];
+            vertex.nx = normals[3 * vtx];
+            vertex.ny = normals[3 * vtx + 1];
+            vertex.nz = normals[3 * vtx + 2];
+            if (cache.hasTexCoords())
+            {
+                vertex.u = texCoords[2 * vtx];
+                vertex.v = texCoords[2 * vtx + 1];
+            }
+            vertices.push_back(vertex);
+        }
+        double seconds = chrono::duration<double>(
+                            chrono::steady_clock::now() - start).count();
+
+        best = min(best, seconds);
+        total += seconds;
+        hash = checksum(vertices);
+    }
+
+    cout << "Cache size: " << filesystem::file_size(MeshCache::filename(scaled))
+            / 1e6 << " MB\n"
+         << "Cache load time: best " << best * 1e3 << " ms, mean "
+         << total / runs * 1e3 << " ms over " << runs << " runs\n"
+         << "Checksum of cached data: " << hex << hash << dec << '\n';
+
+    filesystem::remove(scaled);
+    filesystem::remove(MeshCache::filename(scaled));
+    return 0;
+}
+catch (exception const &ex)
+{
+    cerr << "Error: " << ex.what() << '\n';
+    return 1;
+}
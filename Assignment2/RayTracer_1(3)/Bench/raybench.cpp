@@ -0,0 +1,459 @@
+// Render benchmark over the example scenes.
+//
+// Renders every scene under Scenes/ (or the scene files given) and three
+// synthetic stress scenes with many spheres, triangles and lights a number
+// of times. For every scene it reports the time spent parsing, building the
+// scene BVH and tracing, the primary rays traced per second and the peak
+// memory use. With --json the results are written as JSON as well, for
+// tracking them over time. With --verify every render is compared with a
+// render of the same scene on a single thread, which checks that tracing
+// from several threads gives the same image. Exits with 1 if a scene
+// cannot be loaded or (with --verify) a render differs.
+//
+// Usage: raybench [options] [scene.json ...]
+
+#include "camera.h"
+#include "image.h"
+#include "raytracer.h"
+#include "rendersettings.h"
+#include "simd.h"
+#include "stats.h"
+#include "tilescheduler.h"
+
+#include "json/json.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+namespace
+{
+    void usage(char const *prog)
+    {
+        cerr << "Usage: " << prog << " [options] [scene.json ...]\n"
+                "Options:\n"
+                "  -n, --runs N      render every scene N times "
+                                    "(default: 3)\n"
+                "  -t, --threads N   render on N threads "
+                                    "(default: all hardware threads)\n"
+                "  --thread-buffers  render every tile into a buffer of "
+                                    "the thread first\n"
+                "  --scenes DIR      render all scenes below DIR when no "
+                                    "scene is given\n"
+                "                    (default: ../Scenes)\n"
+                "  --stress N        number of primitives (or lights) in "
+                                    "the stress scenes, 0 to skip them\n"
+                "                    (default: 10000)\n"
+                "  --json FILE       also write the results as JSON, "
+                                    "- for stdout\n"
+                "  --verify          compare every render with one on a "
+                                    "single thread\n"
+                "  -v, --verbose     show the output of the ray tracer\n";
+    }
+
+    // Minimum and mean over the runs of a scene
+    struct Measure
+    {
+        double best = 0.0;
+        double mean = 0.0;
+
+        void add(double value, unsigned run)
+        {
+            best = run == 0 ? value : min(best, value);
+            mean += (value - mean) / (run + 1);
+        }
+    };
+
+    struct Result
+    {
+        string scene;
+        bool ok = true;
+        Measure parseMs;
+        Measure buildMs;
+        Measure renderMs;
+        unsigned long long rays = 0;    // primary rays per render
+        double peakMB = 0.0;
+        unsigned long long mismatches = 0;  // pixels, with --verify
+    };
+
+    // number of pixels that differ in any channel
+    unsigned long long differingPixels(Image const &img, Image const &other)
+    {
+        unsigned long long count = 0;
+        for (unsigned y = 0; y != img.height(); ++y)
+        {
+            for (unsigned x = 0; x != img.width(); ++x)
+            {
+                Color const &a = img(x, y);
+                Color const &b = other(x, y);
+                if (a.r != b.r || a.g != b.g || a.b != b.b)
+                    ++count;
+            }
+        }
+        return count;
+    }
+
+    // Peak resident memory. On Linux the peak is reset before every run
+    // (through /proc/self/clear_refs) so it covers that run only.
+    bool resetPeakMemory()
+    {
+        ofstream clear("/proc/self/clear_refs");
+        return clear && (clear << "5").flush();
+    }
+
+    double peakMemoryMB()
+    {
+        ifstream status("/proc/self/status");
+        for (string line; getline(status, line); )
+            if (line.compare(0, 6, "VmHWM:") == 0)
+                return stod(line.substr(6)) / 1024.0;  // in kB
+#ifdef __linux__
+        rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0)
+            return usage.ru_maxrss / 1024.0;
+#endif
+        return 0.0;
+    }
+
+    json material(mt19937 &random)
+    {
+        uniform_real_distribution<double> unit(0.0, 1.0);
+        return json{ { "color", { unit(random), unit(random),
+                                  unit(random) } },
+                     { "ka", 0.2 }, { "kd", 0.7 }, { "ks", 0.5 },
+                     { "n", 32 } };
+    }
+
+    json stressBase()
+    {
+        return json{ { "Eye", { 200, 200, 1000 } },
+                     { "Lights", {
+                        { { "position", { -200, 600, 1500 } },
+                          { "color", { 1.0, 1.0, 1.0 } } },
+                        { { "position", { 600, 800, 1000 } },
+                          { "color", { 0.5, 0.5, 0.5 } } } } },
+                     { "Objects", json::array() } };
+    }
+
+    // count spheres at random positions in front of the camera
+    json sphereScene(unsigned count)
+    {
+        mt19937 random(1);
+        uniform_real_distribution<double> xy(0.0, 400.0);
+        uniform_real_distribution<double> z(-400.0, 0.0);
+        double radius = 400.0 / sqrt(count);
+
+        json scene = stressBase();
+        for (unsigned idx = 0; idx != count; ++idx)
+            scene["Objects"].push_back(
+                { { "type", "sphere" },
+                  { "position", { xy(random), xy(random), z(random) } },
+                  { "radius", radius },
+                  { "material", material(random) } });
+        return scene;
+    }
+
+    // count small triangles at random positions and orientations
+    json triangleScene(unsigned count)
+    {
+        mt19937 random(2);
+        uniform_real_distribution<double> xy(0.0, 400.0);
+        uniform_real_distribution<double> z(-400.0, 0.0);
+        double size = 800.0 / sqrt(count);
+        uniform_real_distribution<double> offset(-size, size);
+
+        json scene = stressBase();
+        for (unsigned idx = 0; idx != count; ++idx)
+        {
+            double x = xy(random);
+            double y = xy(random);
+            double d = z(random);
+            json corners;
+            for (unsigned corner = 0; corner != 3; ++corner)
+                corners.push_back({ x + offset(random), y + offset(random),
+                                    d + offset(random) });
+            scene["Objects"].push_back(
+                { { "type", "triangle" }, { "v0", corners[0] },
+                  { "v1", corners[1] }, { "v2", corners[2] },
+                  { "material", material(random) } });
+        }
+        return scene;
+    }
+
+    // count small lights with a radius in a plane in front of a grid of
+    // spheres, about 64 of them reach every point
+    json lightScene(unsigned count)
+    {
+        mt19937 random(3);
+        uniform_real_distribution<double> xy(-100.0, 500.0);
+        uniform_real_distribution<double> channel(0.0, 1.0);
+        double radius = sqrt(64 * 600.0 * 600.0 / (3.14159265358979 * count));
+
+        json scene = stressBase();
+        scene["Lights"] = json::array();
+        for (unsigned idx = 0; idx != count; ++idx)
+            scene["Lights"].push_back(
+                { { "position", { xy(random), xy(random), 0.0 } },
+                  { "color", { channel(random), channel(random),
+                               channel(random) } },
+                  { "attenuation", { 1.0, 0.0, 4.0 / (radius * radius) } },
+                  { "radius", radius } });
+        for (unsigned row = 0; row != 10; ++row)
+            for (unsigned col = 0; col != 10; ++col)
+                scene["Objects"].push_back(
+                    { { "type", "sphere" },
+                      { "position", { 20.0 + 40 * col, 20.0 + 40 * row,
+                                      -20.0 } },
+                      { "radius", 18.0 },
+                      { "material", material(random) } });
+        return scene;
+    }
+
+    string writeScene(json const &scene, string const &name)
+    {
+        string filename = (fs::temp_directory_path() / name).string();
+        ofstream out(filename);
+        out << scene;
+        if (!out)
+            throw runtime_error("cannot write " + filename);
+        return filename;
+    }
+
+    Result benchmark(string const &filename, string const &name,
+                     RenderSettings const &settings, unsigned runs,
+                     bool verify, bool verbose)
+    {
+        Result result;
+        result.scene = name;
+
+        ostringstream quiet;
+        for (unsigned run = 0; run != runs && result.ok; ++run)
+        {
+            // The ray tracer reports on cout (and errors on cerr)
+            streambuf *coutBuf = cout.rdbuf();
+            if (!verbose)
+                cout.rdbuf(quiet.rdbuf());
+            quiet.str("");
+
+            resetPeakMemory();
+            {
+                Raytracer raytracer;
+                raytracer.setRenderSettings(settings);
+                result.ok = raytracer.readScene(filename);
+                if (result.ok)
+                {
+                    Camera const &camera = raytracer.getScene().getCamera();
+                    Image img(camera.width, camera.height);
+                    raytracer.render(img);
+
+                    // counted if compiled in, else one ray per sample
+                    unsigned samples = raytracer.getScene().getSuperSampling();
+                    result.rays = Stats::enabled()
+                                ? Stats::total()[Stats::PRIMARY_RAYS]
+                                : 1ULL * camera.width * camera.height
+                                  * samples * samples;
+                    Raytracer::Timing const &timing = raytracer.getTiming();
+                    result.parseMs.add(timing.parseMs, run);
+                    result.buildMs.add(timing.buildMs, run);
+                    result.renderMs.add(timing.renderMs, run);
+
+                    if (verify)
+                    {
+                        // the same scene, traced on one thread only
+                        RenderSettings serial = settings;
+                        serial.numThreads = 1;
+                        raytracer.setRenderSettings(serial);
+                        Image reference(camera.width, camera.height);
+                        raytracer.render(reference);
+                        result.mismatches = max(result.mismatches,
+                                                differingPixels(img,
+                                                                reference));
+                    }
+                }
+                result.peakMB = max(result.peakMB, peakMemoryMB());
+            }
+            cout.rdbuf(coutBuf);
+        }
+        return result;
+    }
+
+    json toJson(Measure const &measure)
+    {
+        return json{ { "best", measure.best }, { "mean", measure.mean } };
+    }
+}
+
+int main(int argc, char *argv[])
+try
+{
+    RenderSettings settings;
+    unsigned runs = 3;
+    unsigned stressSize = 10000;
+    string sceneDir = "../Scenes";
+    string jsonFile;
+    bool verify = false;
+    bool verbose = false;
+    vector<string> scenes;
+
+    for (int idx = 1; idx < argc; ++idx)
+    {
+        string arg = argv[idx];
+        bool hasValue = idx + 1 < argc;
+
+        if ((arg == "-n" || arg == "--runs") && hasValue)
+            runs = max(1UL, stoul(argv[++idx]));
+        else if ((arg == "-t" || arg == "--threads") && hasValue)
+            settings.numThreads = stoul(argv[++idx]);
+        else if (arg == "--thread-buffers")
+            settings.threadBuffers = true;
+        else if (arg == "--scenes" && hasValue)
+            sceneDir = argv[++idx];
+        else if (arg == "--stress" && hasValue)
+            stressSize = stoul(argv[++idx]);
+        else if (arg == "--json" && hasValue)
+            jsonFile = argv[++idx];
+        else if (arg == "--verify")
+            verify = true;
+        else if (arg == "-v" || arg == "--verbose")
+            verbose = true;
+        else if (arg[0] != '-')
+            scenes.push_back(arg);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // name and file of every scene to render
+    vector<pair<string, string>> jobs;
+    for (string const &scene : scenes)
+        jobs.emplace_back(scene, scene);
+    if (scenes.empty())
+    {
+        for (auto const &entry : fs::recursive_directory_iterator(sceneDir))
+            if (entry.is_regular_file()
+                && entry.path().extension() == ".json")
+                jobs.emplace_back(
+                    fs::relative(entry.path(), sceneDir).string(),
+                    entry.path().string());
+        sort(jobs.begin(), jobs.end());
+    }
+
+    vector<string> generated;
+    if (stressSize != 0)
+    {
+        string spheres = "stress_spheres_" + to_string(stressSize);
+        string triangles = "stress_triangles_" + to_string(stressSize);
+        string lights = "stress_lights_" + to_string(stressSize);
+        generated.push_back(writeScene(sphereScene(stressSize),
+                                       spheres + ".json"));
+        jobs.emplace_back(spheres, generated.back());
+        generated.push_back(writeScene(triangleScene(stressSize),
+                                       triangles + ".json"));
+        jobs.emplace_back(triangles, generated.back());
+        generated.push_back(writeScene(lightScene(stressSize),
+                                       lights + ".json"));
+        jobs.emplace_back(lights, generated.back());
+    }
+
+    unsigned numThreads = settings.numThreads == 0
+                        ? TileScheduler::defaultThreadCount()
+                        : settings.numThreads;
+    cout << "Rendering " << jobs.size() << " scenes " << runs
+         << " time(s) on " << numThreads << " thread(s) with "
+         << simdLevelName(simdLevel()) << " kernels.\n"
+         << "Times are the best of all runs, memory is the peak.\n\n";
+
+    size_t nameWidth = 10;
+    for (auto const &job : jobs)
+        nameWidth = max(nameWidth, job.first.size());
+
+    cout << left << setw(nameWidth) << "scene" << right
+         << setw(11) << "parse ms" << setw(11) << "build ms"
+         << setw(11) << "render ms" << setw(11) << "Mrays/s"
+         << setw(11) << "peak MB" << '\n' << fixed << setprecision(2);
+
+    vector<Result> results;
+    bool failed = false;            // a scene failed or differs
+    for (auto const &job : jobs)
+    {
+        Result result = benchmark(job.second, job.first, settings, runs,
+                                  verify, verbose);
+        cout << left << setw(nameWidth) << job.first << right;
+        if (!result.ok)
+            cout << "  failed\n";
+        else
+            cout << setw(11) << result.parseMs.best
+                 << setw(11) << result.buildMs.best
+                 << setw(11) << result.renderMs.best
+                 << setw(11) << result.rays / result.renderMs.best / 1e3
+                 << setw(11) << result.peakMB << '\n';
+        if (result.mismatches != 0)
+            cout << "  " << result.mismatches << " pixels differ from the "
+                    "render on a single thread\n";
+        failed = failed || !result.ok || result.mismatches != 0;
+        results.push_back(result);
+    }
+
+    for (string const &filename : generated)
+        fs::remove(filename);
+
+    if (jsonFile.empty())
+        return failed ? 1 : 0;
+
+    json report = { { "runs", runs }, { "threads", numThreads },
+                    { "simd", simdLevelName(simdLevel()) },
+                    { "scenes", json::array() } };
+    for (Result const &result : results)
+    {
+        json scene = { { "scene", result.scene }, { "ok", result.ok } };
+        if (result.ok)
+        {
+            scene["parseMs"] = toJson(result.parseMs);
+            scene["buildMs"] = toJson(result.buildMs);
+            scene["renderMs"] = toJson(result.renderMs);
+            scene["rays"] = result.rays;
+            scene["raysPerSecond"] = result.rays / result.renderMs.best
+                                     * 1e3;
+            scene["peakMemoryMB"] = result.peakMB;
+            if (verify)
+                scene["mismatchedPixels"] = result.mismatches;
+        }
+        report["scenes"].push_back(scene);
+    }
+
+    if (jsonFile == "-")
+        cout << '\n' << report.dump(4) << '\n';
+    else
+    {
+        ofstream out(jsonFile);
+        out << report.dump(4) << '\n';
+        if (!out)
+            throw runtime_error("cannot write " + jsonFile);
+        cout << "\nResults written to " << jsonFile << ".\n";
+    }
+    return failed ? 1 : 0;
+}
+catch (exception const &ex)
+{
+    cerr << "Error: " << ex.what() << '\n';
+    return 1;
+}
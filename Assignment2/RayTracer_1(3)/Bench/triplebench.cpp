@@ -0,0 +1,163 @@
+// Micro benchmark of the Triple arithmetic.
+//
+// Times dot(), cross() and normalized() over arrays of random vectors, and
+// the Phong term of Scene::shade() for a number of lights per hit point.
+// The arrays are small enough to stay in the cache and are passed over a
+// number of times per run. Reports the best time per operation (per light
+// for Phong) over a number of runs. The sum of all results is printed so the
+// work cannot be optimized away, and so the output of different Triple
+// versions can be compared.
+//
+// Usage: triplebench [count] [runs] [lights]
+
+#include "triple.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    vector<Vector> randomVectors(mt19937 &random, size_t count,
+                                 double range)
+    {
+        uniform_real_distribution<double> coordinate(-range, range);
+        vector<Vector> vectors;
+        vectors.reserve(count);
+        for (size_t idx = 0; idx != count; ++idx)
+            vectors.emplace_back(coordinate(random), coordinate(random),
+                                 coordinate(random));
+        return vectors;
+    }
+
+    // Best time of runs times passes calls of body, in ns per operation.
+    // body does ops operations and returns a result that is added to sum.
+    double bestTime(unsigned runs, unsigned passes, size_t ops, double &sum,
+                    function<double()> const &body)
+    {
+        double best = 1e300;
+        for (unsigned run = 0; run != runs; ++run)
+        {
+            auto start = chrono::steady_clock::now();
+            for (unsigned pass = 0; pass != passes; ++pass)
+                sum += body();
+            double seconds = chrono::duration<double>(
+                                chrono::steady_clock::now() - start).count();
+            best = min(best, seconds);
+        }
+        return best * 1e9 / (double(passes) * ops);
+    }
+
+    void report(string const &name, double ns)
+    {
+        cout << left << setw(14) << name << right << fixed
+             << setprecision(2) << setw(8) << ns << " ns/op\n";
+    }
+}
+
+int main(int argc, char *argv[])
+try
+{
+    size_t count = argc > 1 ? stoul(argv[1]) : 4096;
+    unsigned runs = argc > 2 ? stoul(argv[2]) : 5;
+    unsigned numLights = argc > 3 ? stoul(argv[3]) : 8;
+    unsigned passes = max<size_t>(1, (1 << 22) / count);
+
+    mt19937 random(1);
+    vector<Vector> a = randomVectors(random, count, 1.0);
+    vector<Vector> b = randomVectors(random, count, 1.0);
+    vector<Vector> normals = randomVectors(random, count, 1.0);
+    for (Vector &N : normals)
+        N.normalize();
+
+    // lights around a scene of 400 x 400 x 400, as in the example scenes
+    vector<Point> lightPos = randomVectors(random, numLights, 1000.0);
+    vector<Color> lightColor = randomVectors(random, numLights, 0.5);
+    for (Color &color : lightColor)
+        color += 0.5;
+
+    cout << "Triple benchmark: " << count << " vectors x " << passes
+         << " passes, best of " << runs << " runs, " << numLights
+         << " lights for Phong\n";
+
+    double sum = 0;
+
+    report("dot", bestTime(runs, passes, count, sum, [&]
+    {
+        double result = 0;
+        for (size_t idx = 0; idx != count; ++idx)
+            result += a[idx].dot(b[idx]);
+        return result;
+    }));
+
+    report("cross", bestTime(runs, passes, count, sum, [&]
+    {
+        Vector result;
+        for (size_t idx = 0; idx != count; ++idx)
+            result += a[idx].cross(b[idx]);
+        return result.x + result.y + result.z;
+    }));
+
+    report("normalized", bestTime(runs, passes, count, sum, [&]
+    {
+        Vector result;
+        for (size_t idx = 0; idx != count; ++idx)
+            result += a[idx].normalized();
+        return result.x + result.y + result.z;
+    }));
+
+    // The Phong term of Scene::shade(): a hit point, its normal and the
+    // view vector per element, all lights at every hit point
+    Color const matColor(0.8, 0.6, 0.4);
+    double const ka = 0.2;
+    double const kd = 0.7;
+    double const ks = 0.5;
+    double const n = 32;
+    unsigned const phongPasses = max(1U, passes / numLights);
+    report("phong/light", bestTime(runs, phongPasses, count * numLights, sum,
+                                   [&]
+    {
+        Color result;
+        for (size_t idx = 0; idx != count; ++idx)
+        {
+            Point const hit = 400.0 * a[idx];
+            Vector const &N = normals[idx];
+            Vector const V = -b[idx].normalized();
+
+            Color color = matColor * ka;
+            for (unsigned light = 0; light != numLights; ++light)
+            {
+                Vector L = (lightPos[light] - hit).normalized();
+                double NL = N.dot(L);
+                Color diffuse = lightColor[light]
+                                * (max<double>(0.0, NL) * kd);
+                Color specular;
+                if (NL > 0)
+                {
+                    Vector R = ((2.0 * NL) * N - L).normalized();
+                    specular = lightColor[light]
+                               * (pow(max<double>(0.0, R.dot(V)), n) * ks);
+                }
+                color += matColor * diffuse + specular;
+            }
+            result += color;
+        }
+        return result.r + result.g + result.b;
+    }));
+
+    cout << "Sum of all results: " << setprecision(6) << sum << '\n';
+    return 0;
+}
+catch (exception const &ex)
+{
+    cerr << "Error: " << ex.what() << '\n';
+    return 1;
+}
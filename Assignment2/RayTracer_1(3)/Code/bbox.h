@@ -0,0 +1,116 @@
+#ifndef BBOX_H_
+#define BBOX_H_
+
+#include "ray.h"
+#include "triple.h"
+
+#include <algorithm>
+#include <limits>
+
+// Axis aligned bounding box. POD class. A default constructed box is empty
+// (min > max) and can be grown with extend().
+class BBox
+{
+    public:
+        Point min;
+        Point max;
+
+        BBox()
+        :
+            min(std::numeric_limits<real>::infinity(),
+                std::numeric_limits<real>::infinity(),
+                std::numeric_limits<real>::infinity()),
+            max(-std::numeric_limits<real>::infinity(),
+                -std::numeric_limits<real>::infinity(),
+                -std::numeric_limits<real>::infinity())
+        {}
+
+        BBox(Point const &lower, Point const &upper)
+        :
+            min(lower),
+            max(upper)
+        {}
+
+        void extend(Point const &p)
+        {
+            for (int axis = 0; axis != 3; ++axis)
+            {
+                min.data[axis] = std::min(min.data[axis], p.data[axis]);
+                max.data[axis] = std::max(max.data[axis], p.data[axis]);
+            }
+        }
+
+        void extend(BBox const &box)
+        {
+            for (int axis = 0; axis != 3; ++axis)
+            {
+                min.data[axis] = std::min(min.data[axis], box.min.data[axis]);
+                max.data[axis] = std::max(max.data[axis], box.max.data[axis]);
+            }
+        }
+
+        bool empty() const
+        {
+            return min.x > max.x || min.y > max.y || min.z > max.z;
+        }
+
+        bool contains(Point const &p) const
+        {
+            return p.x >= min.x && p.x <= max.x && p.y >= min.y
+                && p.y <= max.y && p.z >= min.z && p.z <= max.z;
+        }
+
+        Point centroid() const
+        {
+            return 0.5 * (min + max);
+        }
+
+        // surface area, the cost measure used to build the BVH
+        double area() const
+        {
+            if (empty())
+                return 0.0;
+            Vector d = max - min;
+            return 2.0 * (d.x * d.y + d.y * d.z + d.z * d.x);
+        }
+
+        int longestAxis() const
+        {
+            Vector d = max - min;
+            if (d.x >= d.y && d.x >= d.z)
+                return 0;
+            return d.y >= d.z ? 1 : 2;
+        }
+
+        // Slab test. invD holds 1 / ray.D per component. Returns whether the
+        // ray passes through the box somewhere in [0, tMax], the entry
+        // distance is stored in tNear. NaNs (0 * inf) are ignored.
+        bool intersect(Ray const &ray, Vector const &invD,
+                       real tMax, real &tNear) const
+        {
+            return intersect(ray.O.data, invD.data, tMax, tNear);
+        }
+
+        // same, with the ray's origin and inverse direction as arrays
+        bool intersect(real const *O, real const *invD,
+                       real tMax, real &tNear) const
+        {
+            real t0 = 0.0;
+            real t1 = tMax;
+            for (int axis = 0; axis != 3; ++axis)
+            {
+                real tA = (min.data[axis] - O[axis]) * invD[axis];
+                real tB = (max.data[axis] - O[axis]) * invD[axis];
+                if (tA > tB)
+                    std::swap(tA, tB);
+                t0 = tA > t0 ? tA : t0;
+                t1 = tB < t1 ? tB : t1;
+                if (t0 > t1)
+                    return false;
+            }
+            tNear = t0;
+            return true;
+        }
+};
+
+#endif
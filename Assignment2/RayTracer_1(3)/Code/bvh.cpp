@@ -0,0 +1,199 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+namespace
+{
+    // SAH cost of traversing an inner node relative to one primitive test
+    double const TRAVERSAL_COST = 1.0;
+
+    unsigned const NUM_BINS = 16;
+
+    // keeps the traversal stack (64 entries) from overflowing
+    unsigned const MAX_DEPTH = 60;
+}
+
+void BVH::build(vector<BBox> const &primBounds, unsigned maxLeafSize)
+{
+    auto start = chrono::steady_clock::now();
+
+    d_nodes.clear();
+    d_stats = BuildStats();
+    d_stats.primitives = primBounds.size();
+
+    d_indices.resize(primBounds.size());
+    vector<Point> centroids(primBounds.size());
+    for (unsigned idx = 0; idx != primBounds.size(); ++idx)
+    {
+        d_indices[idx] = idx;
+        centroids[idx] = primBounds[idx].centroid();
+    }
+
+    if (!primBounds.empty())
+    {
+        d_nodes.reserve(2 * primBounds.size());
+        buildNode(primBounds, centroids, 0, primBounds.size(),
+                  max(maxLeafSize, 1U), 1);
+
+        // SAH cost of the finished tree, relative to the root's area
+        double rootArea = d_nodes[0].box.area();
+        for (Node const &node : d_nodes)
+        {
+            double weight = rootArea > 0 ? node.box.area() / rootArea : 1.0;
+            d_stats.sahCost += weight * (node.count == 0 ? TRAVERSAL_COST
+                                                         : node.count);
+        }
+    }
+
+    d_stats.nodes = d_nodes.size();
+    d_stats.buildMs = chrono::duration<double, milli>(
+                            chrono::steady_clock::now() - start).count();
+}
+
+unsigned BVH::buildNode(vector<BBox> const &primBounds,
+                        vector<Point> const &centroids,
+                        unsigned first, unsigned count,
+                        unsigned maxLeafSize, unsigned depth)
+{
+    unsigned nodeIdx = d_nodes.size();
+    d_nodes.push_back(Node());
+    d_stats.maxDepth = max(d_stats.maxDepth, depth);
+
+    BBox box;
+    BBox centroidBox;
+    for (unsigned idx = first; idx != first + count; ++idx)
+    {
+        box.extend(primBounds[d_indices[idx]]);
+        centroidBox.extend(centroids[d_indices[idx]]);
+    }
+    d_nodes[nodeIdx].box = box;
+
+    auto makeLeaf = [&]()
+    {
+        d_nodes[nodeIdx].offset = first;
+        d_nodes[nodeIdx].count = count;
+        ++d_stats.leaves;
+        d_stats.maxLeafSize = max(d_stats.maxLeafSize, count);
+        return nodeIdx;
+    };
+
+    int axis = centroidBox.longestAxis();
+    double lower = centroidBox.min.data[axis];
+    double extent = centroidBox.max.data[axis] - lower;
+
+    // all centroids coincide: no split can separate them
+    if (count <= 1 || !(extent > 0) || depth >= MAX_DEPTH)
+        return makeLeaf();
+
+    // Bin the centroids along the longest axis and evaluate the SAH for
+    // every split between two bins.
+    struct Bin
+    {
+        BBox box;
+        unsigned count = 0;
+    };
+    Bin bins[NUM_BINS];
+
+    auto binOf = [&](unsigned prim)
+    {
+        unsigned bin = (centroids[prim].data[axis] - lower) / extent * NUM_BINS;
+        return min(bin, NUM_BINS - 1);
+    };
+
+    for (unsigned idx = first; idx != first + count; ++idx)
+    {
+        Bin &bin = bins[binOf(d_indices[idx])];
+        bin.box.extend(primBounds[d_indices[idx]]);
+        ++bin.count;
+    }
+
+    // rightArea[i] and rightCount[i] describe bins i .. NUM_BINS - 1
+    double rightArea[NUM_BINS];
+    unsigned rightCount[NUM_BINS];
+    BBox acc;
+    unsigned accCount = 0;
+    for (unsigned bin = NUM_BINS; bin-- != 1; )
+    {
+        acc.extend(bins[bin].box);
+        accCount += bins[bin].count;
+        rightArea[bin] = acc.area();
+        rightCount[bin] = accCount;
+    }
+
+    double bestCost = numeric_limits<double>::infinity();
+    unsigned bestSplit = 0;
+    acc = BBox();
+    accCount = 0;
+    for (unsigned split = 1; split != NUM_BINS; ++split)
+    {
+        acc.extend(bins[split - 1].box);
+        accCount += bins[split - 1].count;
+        if (accCount == 0 || rightCount[split] == 0)
+            continue;
+
+        double cost = acc.area() * accCount
+                    + rightArea[split] * rightCount[split];
+        if (cost < bestCost)
+        {
+            bestCost = cost;
+            bestSplit = split;
+        }
+    }
+
+    // Split only when it is expected to be cheaper than testing everything
+    double leafCost = box.area() * count;
+    double splitCost = TRAVERSAL_COST * box.area() + bestCost;
+    if (bestSplit == 0 || (count <= maxLeafSize && splitCost >= leafCost))
+        return makeLeaf();
+
+    unsigned *mid = partition(&d_indices[first], &d_indices[first] + count,
+                              [&](unsigned prim)
+                              {
+                                  return binOf(prim) < bestSplit;
+                              });
+    unsigned leftCount = mid - &d_indices[first];
+
+    d_nodes[nodeIdx].axis = axis;
+    d_nodes[nodeIdx].count = 0;
+    buildNode(primBounds, centroids, first, leftCount, maxLeafSize, depth + 1);
+    unsigned right = buildNode(primBounds, centroids, first + leftCount,
+                               count - leftCount, maxLeafSize, depth + 1);
+    d_nodes[nodeIdx].offset = right;
+    return nodeIdx;
+}
+
+BBox BVH::bounds() const
+{
+    return d_nodes.empty() ? BBox() : d_nodes[0].box;
+}
+
+bool BVH::empty() const
+{
+    return d_nodes.empty();
+}
+
+vector<unsigned> const &BVH::indices() const
+{
+    return d_indices;
+}
+
+BVH::BuildStats const &BVH::buildStats() const
+{
+    return d_stats;
+}
+
+// --- IO Operators ------------------------------------------------------------
+
+ostream &operator<<(ostream &os, BVH::BuildStats const &stats)
+{
+    double avgLeaf = stats.leaves ? double(stats.primitives) / stats.leaves : 0;
+    os << stats.nodes << " nodes, " << stats.leaves << " leaves (avg "
+       << avgLeaf << ", max " << stats.maxLeafSize << " primitives), depth "
+       << stats.maxDepth << ", SAH cost " << stats.sahCost << ", built in "
+       << stats.buildMs << " ms";
+    return os;
+}
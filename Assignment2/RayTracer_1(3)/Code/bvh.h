@@ -0,0 +1,297 @@
+#ifndef BVH_H_
+#define BVH_H_
+
+#include "bbox.h"
+#include "packet.h"
+#include "ray.h"
+#include "stats.h"
+#include "triple.h"
+
+#include <iosfwd>
+#include <vector>
+
+// Bounding volume hierarchy over a set of primitives that are only known by
+// their bounding boxes. The tree is built with the surface area heuristic
+// (SAH) and stored depth first: the left child of an inner node directly
+// follows its parent, the right child is stored at node.offset.
+//
+// Leaves refer to a contiguous range of indices(), so owners may reorder
+// their primitives in that order and intersect leaf ranges directly.
+class BVH
+{
+    public:
+        struct Node
+        {
+            BBox box;
+            unsigned offset;    // leaf: first index, inner: right child
+            unsigned count;     // number of primitives, 0 for inner nodes
+            unsigned axis;      // split axis of an inner node
+        };
+
+        struct BuildStats
+        {
+            unsigned primitives = 0;
+            unsigned nodes = 0;
+            unsigned leaves = 0;
+            unsigned maxDepth = 0;
+            unsigned maxLeafSize = 0;
+            double sahCost = 0.0;   // expected cost relative to one test
+            double buildMs = 0.0;
+        };
+
+    private:
+        std::vector<Node> d_nodes;
+        std::vector<unsigned> d_indices;    // primitive indices, leaf order
+        BuildStats d_stats;
+
+    public:
+        // builds the tree over primitive i with bounding box primBounds[i]
+        void build(std::vector<BBox> const &primBounds,
+                   unsigned maxLeafSize = 4);
+
+        BBox bounds() const;
+        bool empty() const;
+
+        std::vector<unsigned> const &indices() const;
+        BuildStats const &buildStats() const;
+
+        // Visits the leaves hit by the ray in front to back order, pruning
+        // nodes beyond tMax. visitLeaf(first, count, tMax) must test
+        // indices()[first] up to indices()[first + count] and lower tMax
+        // to the distance of any closer hit it finds.
+        template <typename Visitor>
+        void traverse(Ray const &ray, double &tMax, Visitor &&visitLeaf) const;
+
+        // Any-hit query: visits the leaves hit by the ray within tMax until
+        // visitLeaf(first, count) returns true, i.e. until one of the
+        // primitives of a leaf blocks the ray. Returns whether one did.
+        // Leaves are visited near child first, but the first blocker found
+        // need not be the closest.
+        template <typename Visitor>
+        bool occluded(Ray const &ray, double tMax, Visitor &&visitLeaf) const;
+
+        // The same for the rays of a packet that are in mask, which must be
+        // coherent(). A node is visited when at least one of the rays passes
+        // through it within its own tMax[lane].
+        // visitLeaf(first, count, laneMask, tMax) gets the mask of those
+        // rays and lowers their tMax on closer hits.
+        template <typename Visitor>
+        void traverse(RayPacket const &packet, unsigned mask, double *tMax,
+                      Visitor &&visitLeaf) const;
+
+        // Point query: visits the leaves whose boxes contain p, calling
+        // visitLeaf(first, count) for each of them.
+        template <typename Visitor>
+        void query(Point const &p, Visitor &&visitLeaf) const;
+
+    private:
+        unsigned buildNode(std::vector<BBox> const &primBounds,
+                           std::vector<Point> const &centroids,
+                           unsigned first, unsigned count,
+                           unsigned maxLeafSize, unsigned depth);
+};
+
+std::ostream &operator<<(std::ostream &os, BVH::BuildStats const &stats);
+
+template <typename Visitor>
+void BVH::traverse(Ray const &ray, double &tMax, Visitor &&visitLeaf) const
+{
+    if (d_nodes.empty())
+        return;
+
+    Vector invD(1.0 / ray.D.x, 1.0 / ray.D.y, 1.0 / ray.D.z);
+    unsigned long long visited = 0;
+    unsigned long long tested = 0;
+
+    unsigned stack[64];
+    unsigned top = 0;
+    stack[top++] = 0;
+
+    while (top != 0)
+    {
+        Node const &node = d_nodes[stack[--top]];
+        ++visited;
+
+        real tNear;
+        if (!node.box.intersect(ray, invD, tMax, tNear))
+            continue;
+
+        if (node.count != 0)
+        {
+            tested += node.count;
+            visitLeaf(node.offset, node.count, tMax);
+            continue;
+        }
+
+        // Push the far child first so the near child is popped first
+        unsigned left = &node - d_nodes.data() + 1;
+        if (ray.D.data[node.axis] < 0)
+        {
+            stack[top++] = left;
+            stack[top++] = node.offset;
+        }
+        else
+        {
+            stack[top++] = node.offset;
+            stack[top++] = left;
+        }
+    }
+
+    STATS_INC(BVH_TRAVERSALS);
+    STATS_ADD(BVH_NODES, visited);
+    STATS_ADD(BVH_LEAF_PRIMITIVES, tested);
+}
+
+template <typename Visitor>
+bool BVH::occluded(Ray const &ray, double tMax, Visitor &&visitLeaf) const
+{
+    if (d_nodes.empty())
+        return false;
+
+    Vector invD(1.0 / ray.D.x, 1.0 / ray.D.y, 1.0 / ray.D.z);
+    unsigned long long visited = 0;
+    unsigned long long tested = 0;
+    bool blocked = false;
+
+    unsigned stack[64];
+    unsigned top = 0;
+    stack[top++] = 0;
+
+    while (top != 0)
+    {
+        Node const &node = d_nodes[stack[--top]];
+        ++visited;
+
+        real tNear;
+        if (!node.box.intersect(ray, invD, tMax, tNear))
+            continue;
+
+        if (node.count != 0)
+        {
+            tested += node.count;
+            if (visitLeaf(node.offset, node.count))
+            {
+                blocked = true;
+                break;
+            }
+            continue;
+        }
+
+        unsigned left = &node - d_nodes.data() + 1;
+        if (ray.D.data[node.axis] < 0)
+        {
+            stack[top++] = left;
+            stack[top++] = node.offset;
+        }
+        else
+        {
+            stack[top++] = node.offset;
+            stack[top++] = left;
+        }
+    }
+
+    STATS_INC(BVH_OCCLUSION_TRAVERSALS);
+    STATS_ADD(BVH_NODES, visited);
+    STATS_ADD(BVH_LEAF_PRIMITIVES, tested);
+    return blocked;
+}
+
+template <typename Visitor>
+void BVH::query(Point const &p, Visitor &&visitLeaf) const
+{
+    if (d_nodes.empty())
+        return;
+
+    unsigned stack[64];
+    unsigned top = 0;
+    stack[top++] = 0;
+
+    while (top != 0)
+    {
+        Node const &node = d_nodes[stack[--top]];
+        if (!node.box.contains(p))
+            continue;
+
+        if (node.count != 0)
+        {
+            visitLeaf(node.offset, node.count);
+            continue;
+        }
+
+        stack[top++] = node.offset;
+        stack[top++] = &node - d_nodes.data() + 1;
+    }
+}
+
+template <typename Visitor>
+void BVH::traverse(RayPacket const &packet, unsigned mask, double *tMax,
+                   Visitor &&visitLeaf) const
+{
+    if (d_nodes.empty() || mask == 0)
+        return;
+
+    real O[RayPacket::SIZE][3];
+    real invD[RayPacket::SIZE][3];
+    unsigned firstLane = RayPacket::SIZE;
+    for (unsigned lane = 0; lane != RayPacket::SIZE; ++lane)
+    {
+        if (!(mask >> lane & 1))
+            continue;
+        firstLane = lane < firstLane ? lane : firstLane;
+        for (unsigned axis = 0; axis != 3; ++axis)
+        {
+            O[lane][axis] = packet.O[axis][lane];
+            invD[lane][axis] = real(1) / packet.D[axis][lane];
+        }
+    }
+
+    unsigned long long visited = 0;
+    unsigned long long tested = 0;
+
+    // node index and the rays that passed through its parent
+    unsigned stack[64];
+    unsigned stackMask[64];
+    unsigned top = 0;
+    stack[top] = 0;
+    stackMask[top++] = mask;
+
+    while (top != 0)
+    {
+        --top;
+        Node const &node = d_nodes[stack[top]];
+        unsigned parentMask = stackMask[top];
+        ++visited;
+
+        unsigned nodeMask = 0;
+        for (unsigned lane = 0; lane != RayPacket::SIZE; ++lane)
+        {
+            real tNear;
+            if ((parentMask >> lane & 1)
+                && node.box.intersect(O[lane], invD[lane], tMax[lane], tNear))
+                nodeMask |= 1U << lane;
+        }
+        if (nodeMask == 0)
+            continue;
+
+        if (node.count != 0)
+        {
+            tested += node.count;
+            visitLeaf(node.offset, node.count, nodeMask, tMax);
+            continue;
+        }
+
+        // All rays share an octant, so the first one decides the order
+        unsigned left = &node - d_nodes.data() + 1;
+        bool leftFirst = !(packet.D[node.axis][firstLane] < 0);
+        stack[top] = leftFirst ? node.offset : left;
+        stackMask[top++] = nodeMask;
+        stack[top] = leftFirst ? left : node.offset;
+        stackMask[top++] = nodeMask;
+    }
+
+    STATS_INC(BVH_PACKET_TRAVERSALS);
+    STATS_ADD(BVH_NODES, visited);
+    STATS_ADD(BVH_LEAF_PRIMITIVES, tested);
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef CAMERA_H_
+#define CAMERA_H_
+
+#include "ray.h"
+#include "triple.h"
+
+// Pinhole camera looking from eye through an image plane of width x height
+// pixels centered at center. Pixels are up.length() units in size: up is
+// the height of one pixel, right its width. Both are perpendicular to the
+// view direction.
+class Camera
+{
+    public:
+        Point eye;
+        Point center;
+        Vector up;
+        Vector right;
+        unsigned width;
+        unsigned height;
+
+        // the image plane used when a scene only specifies "Eye": z = 0,
+        // with pixel (x, y) at (x, height - 1 - y) and a pixel size of 1
+        explicit Camera(Point const &eye = Point(200, 200, 1000),
+                        unsigned width = 400, unsigned height = 400)
+        :
+            eye(eye),
+            center(width / 2.0, height / 2.0, 0),
+            up(0, 1, 0),
+            right(1, 0, 0),
+            width(width),
+            height(height)
+        {}
+
+        // up does not have to be perpendicular to the view direction, only
+        // its plane and length are used
+        Camera(Point const &eye, Point const &center, Vector const &up,
+               unsigned width, unsigned height)
+        :
+            eye(eye),
+            center(center),
+            width(width),
+            height(height)
+        {
+            Vector view = center - eye;
+            double size = up.length();
+            right = view.cross(up).normalized() * size;
+            this->up = right.cross(view).normalized() * size;
+        }
+
+        // ray through image coordinates (x, y), where pixel (x, y) covers
+        // [x, x + 1) x [y, y + 1) and y points down
+        Ray ray(double x, double y) const
+        {
+            Point pixel = center + (x - width / 2.0) * right
+                                 + (height / 2.0 - y) * up;
+            return Ray(eye, (pixel - eye).normalized());
+        }
+};
+
+#endif
@@ -0,0 +1,60 @@
+#include "compiledscene.h"
+
+using namespace std;
+
+void CompiledScene::compile(vector<ObjectPtr> const &objects,
+                            vector<unsigned> const &order)
+{
+    d_primitives.clear();
+    d_materials.clear();
+    d_spheres.clear();
+    d_triangles.clear();
+    d_quads.clear();
+    d_meshes.clear();
+    d_others.clear();
+
+    d_materials.reserve(objects.size());
+    for (ObjectPtr const &obj : objects)
+        d_materials.push_back(obj->material);
+
+    d_primitives.reserve(order.size());
+    for (unsigned idx : order)
+    {
+        Object *obj = objects[idx].get();
+        Primitive prim;
+        prim.object = idx;
+
+        // The shape classes are final, so the exact type is known
+        if (Sphere *sphere = dynamic_cast<Sphere *>(obj))
+        {
+            prim.type = SPHERE;
+            prim.index = d_spheres.size();
+            d_spheres.push_back(sphere->geometry());
+        }
+        else if (Triangle *triangle = dynamic_cast<Triangle *>(obj))
+        {
+            prim.type = TRIANGLE;
+            prim.index = d_triangles.size();
+            d_triangles.push_back(triangle->geometry());
+        }
+        else if (Quad *quad = dynamic_cast<Quad *>(obj))
+        {
+            prim.type = QUAD;
+            prim.index = d_quads.size();
+            d_quads.push_back(quad->geometry());
+        }
+        else if (Mesh *mesh = dynamic_cast<Mesh *>(obj))
+        {
+            prim.type = MESH;
+            prim.index = d_meshes.size();
+            d_meshes.push_back(mesh);
+        }
+        else
+        {
+            prim.type = OTHER;
+            prim.index = d_others.size();
+            d_others.push_back(obj);
+        }
+        d_primitives.push_back(prim);
+    }
+}
@@ -0,0 +1,195 @@
+#ifndef COMPILEDSCENE_H_
+#define COMPILEDSCENE_H_
+
+#include "hit.h"
+#include "material.h"
+#include "object.h"
+#include "packet.h"
+#include "ray.h"
+
+#include "shapes/mesh.h"
+#include "shapes/quad.h"
+#include "shapes/sphere.h"
+#include "shapes/triangle.h"
+
+#include <cstdint>
+#include <vector>
+
+// Flat copy of the objects of a scene for tracing, made by Scene::build().
+// The geometry of the objects is grouped by type in contiguous arrays, and
+// every object is referred to by a type tag and an index into the array of
+// its type, stored in the leaf order of the scene BVH. Intersecting an
+// object is a switch on its tag and a direct call: no shared_ptr copies and
+// no virtual functions. Only shapes without a compiled form (e.g. cylinders)
+// are still intersected through Object.
+//
+// Meshes transform the ray into the space of their shared geometry, which
+// has its own BVH and triangle buffer, and are called directly.
+// The compiled scene refers to the objects it was made from, which must
+// outlive it.
+class CompiledScene
+{
+    public:
+        enum Type : uint8_t
+        {
+            SPHERE,
+            TRIANGLE,
+            QUAD,
+            MESH,
+            OTHER
+        };
+
+        struct Primitive
+        {
+            Type type;
+            unsigned index;     // into the array of its type
+            unsigned object;    // index of the object in the scene
+        };
+
+    private:
+        std::vector<Primitive> d_primitives;    // in BVH leaf order
+        std::vector<Material> d_materials;      // per object
+        std::vector<SphereGeometry> d_spheres;
+        std::vector<TriangleGeometry> d_triangles;
+        std::vector<QuadGeometry> d_quads;
+        std::vector<Mesh const *> d_meshes;
+        std::vector<Object const *> d_others;
+
+    public:
+        // compiles objects, order[i] is the object at position i
+        void compile(std::vector<ObjectPtr> const &objects,
+                     std::vector<unsigned> const &order);
+
+        // the primitive at position pos of the BVH leaf order
+        Primitive const &primitive(unsigned pos) const;
+        Material const &material(unsigned object) const;
+
+        size_t size() const;                    // number of primitives
+
+        // Same results as Object::intersect / occluded / intersectPacket
+        Hit intersect(Primitive const &prim, Ray const &ray) const;
+        bool occluded(Primitive const &prim, Ray const &ray,
+                      double tMax) const;
+        unsigned intersectPacket(Primitive const &prim,
+                                 RayPacket const &packet, unsigned mask,
+                                 PacketHit &hits) const;
+
+        // Object::normal and texCoord, for the closest hit only
+        Vector normal(Primitive const &prim, Ray const &ray,
+                      Hit const &hit) const;
+        TexCoord texCoord(Primitive const &prim, Ray const &ray,
+                          Hit const &hit, double &scale) const;
+};
+
+inline CompiledScene::Primitive const &CompiledScene::primitive(
+    unsigned pos) const
+{
+    return d_primitives[pos];
+}
+
+inline Material const &CompiledScene::material(unsigned object) const
+{
+    return d_materials[object];
+}
+
+inline size_t CompiledScene::size() const
+{
+    return d_primitives.size();
+}
+
+inline Hit CompiledScene::intersect(Primitive const &prim,
+                                    Ray const &ray) const
+{
+    switch (prim.type)
+    {
+        case SPHERE:
+            return d_spheres[prim.index].intersect(ray);
+        case TRIANGLE:
+            return d_triangles[prim.index].intersect(ray);
+        case QUAD:
+            return d_quads[prim.index].intersect(ray);
+        case MESH:
+            return d_meshes[prim.index]->Mesh::intersect(ray);
+        default:
+            return d_others[prim.index]->intersect(ray);
+    }
+}
+
+inline bool CompiledScene::occluded(Primitive const &prim, Ray const &ray,
+                                    double tMax) const
+{
+    switch (prim.type)
+    {
+        case SPHERE:
+            return d_spheres[prim.index].intersect(ray).t < tMax;
+        case TRIANGLE:
+            return d_triangles[prim.index].intersect(ray).t < tMax;
+        case QUAD:
+            return d_quads[prim.index].intersect(ray).t < tMax;
+        case MESH:
+            return d_meshes[prim.index]->Mesh::occluded(ray, tMax);
+        default:
+            return d_others[prim.index]->occluded(ray, tMax);
+    }
+}
+
+inline unsigned CompiledScene::intersectPacket(Primitive const &prim,
+                                               RayPacket const &packet,
+                                               unsigned mask,
+                                               PacketHit &hits) const
+{
+    switch (prim.type)
+    {
+        case SPHERE:
+            return d_spheres[prim.index].intersectPacket(packet, mask, hits);
+        case TRIANGLE:
+            return d_triangles[prim.index].intersectPacket(packet, mask,
+                                                           hits);
+        case QUAD:
+            return d_quads[prim.index].intersectPacket(packet, mask, hits);
+        case MESH:
+            return d_meshes[prim.index]->Mesh::intersectPacket(packet, mask,
+                                                               hits);
+        default:
+            return d_others[prim.index]->intersectPacket(packet, mask, hits);
+    }
+}
+
+inline Vector CompiledScene::normal(Primitive const &prim, Ray const &ray,
+                                    Hit const &hit) const
+{
+    switch (prim.type)
+    {
+        case SPHERE:
+            return d_spheres[prim.index].normalAt(ray, hit.t);
+        case TRIANGLE:
+            return d_triangles[prim.index].normal(ray);
+        case QUAD:
+            return d_quads[prim.index].normal(ray, hit);
+        case MESH:
+            return d_meshes[prim.index]->Mesh::normal(ray, hit);
+        default:
+            return d_others[prim.index]->normal(ray, hit);
+    }
+}
+
+inline TexCoord CompiledScene::texCoord(Primitive const &prim,
+                                        Ray const &ray, Hit const &hit,
+                                        double &scale) const
+{
+    switch (prim.type)
+    {
+        case SPHERE:
+            return d_spheres[prim.index].texCoordAt(ray, hit.t, scale);
+        case TRIANGLE:
+            return d_triangles[prim.index].texCoord(hit, scale);
+        case QUAD:
+            return d_quads[prim.index].texCoord(hit, scale);
+        case MESH:
+            return d_meshes[prim.index]->Mesh::texCoord(ray, hit, scale);
+        default:
+            return d_others[prim.index]->texCoord(ray, hit, scale);
+    }
+}
+
+#endif
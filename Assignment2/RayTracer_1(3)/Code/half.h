@@ -0,0 +1,72 @@
+#ifndef HALF_H_
+#define HALF_H_
+
+#include <cstdint>
+#include <cstring>
+
+// Conversion between float and 16-bit IEEE half precision floats (1 sign,
+// 5 exponent and 10 mantissa bits), for data stored compactly. Floats are
+// rounded to the nearest half, ties to even; values beyond the half range
+// become infinite. Implemented with integer operations, so no instruction
+// set extension (F16C) is needed.
+
+uint16_t floatToHalf(float value);
+float halfToFloat(uint16_t half);
+
+inline uint16_t floatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof bits);
+
+    uint32_t const sign = bits >> 16 & 0x8000;
+    uint32_t mantissa = bits & 0x7fffff;
+    int const exponent = int(bits >> 23 & 0xff) - 127 + 15;
+
+    if (exponent == 128 + 15)               // inf or NaN
+        return sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0);
+    if (exponent >= 31)                     // too large
+        return sign | 0x7c00;
+
+    unsigned shift = 13;                    // mantissa bits dropped
+    uint32_t half = uint32_t(exponent) << 10 | mantissa >> shift;
+    if (exponent <= 0)                      // subnormal or zero
+    {
+        if (exponent < -10)
+            return sign;
+        mantissa |= 0x800000;               // the implicit leading 1
+        shift = 14 - exponent;
+        half = mantissa >> shift;
+    }
+
+    // round to nearest even, a carry may round up to the next exponent
+    uint32_t const rest = mantissa & ((1U << shift) - 1);
+    uint32_t const halfway = 1U << (shift - 1);
+    if (rest > halfway || (rest == halfway && (half & 1)))
+        ++half;
+    return sign | half;
+}
+
+inline float halfToFloat(uint16_t half)
+{
+    uint32_t const sign = uint32_t(half & 0x8000) << 16;
+    uint32_t const exponent = half >> 10 & 0x1f;
+    uint32_t const mantissa = half & 0x3ff;
+
+    uint32_t bits;
+    if (exponent == 0)                      // subnormal or zero: m 2^-24
+    {
+        float value = mantissa * 5.9604644775390625e-8f;
+        std::memcpy(&bits, &value, sizeof bits);
+        bits |= sign;
+    }
+    else if (exponent == 31)                // inf or NaN
+        bits = sign | 0x7f800000 | mantissa << 13;
+    else
+        bits = sign | (exponent + 127 - 15) << 23 | mantissa << 13;
+
+    float value;
+    std::memcpy(&value, &bits, sizeof value);
+    return value;
+}
+
+#endif
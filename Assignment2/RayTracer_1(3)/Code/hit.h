@@ -4,11 +4,19 @@
 #include "triple.h"
 #include <limits>
 
+// Where a ray hits an object. The intersection tests only find the distance
+// and which part of the object was hit; the normal is computed afterwards,
+// only for the closest hit (see Object::normal).
 class Hit
 {
     public:
         double t;   // distance of hit
-        Vector N;   // Normal at hit
+        Vector N;   // Normal at hit, facing the ray (N.dot(ray.D) <= 0)
+
+        unsigned object = 0;    // index of the object in the scene
+        unsigned primitive = 0; // part of the object, e.g. a mesh triangle
+        double u = 0.0;         // barycentric coordinates in a triangle:
+        double v = 0.0;         // (1 - u - v) v0 + u v1 + v v2
 
         Hit(double time, Vector const &normal)
         :
@@ -16,6 +24,16 @@ class Hit
             N(normal)
         {}
 
+        // a hit whose normal is not known yet
+        explicit Hit(double time, unsigned prim = 0, double bu = 0.0,
+                     double bv = 0.0)
+        :
+            t(time),
+            primitive(prim),
+            u(bu),
+            v(bv)
+        {}
+
         static Hit const NO_HIT()
         {
             static Hit no_hit(std::numeric_limits<double>::quiet_NaN(),
@@ -26,4 +44,11 @@ class Hit
         }
 };
 
+// Texture coordinates at a hit, u and v in vertex.h, see Texture
+struct TexCoord
+{
+    double s;
+    double t;
+};
+
 #endif
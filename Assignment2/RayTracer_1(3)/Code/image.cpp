@@ -1,8 +1,10 @@
 #include "image.h"
 
 #include "lode/lodepng.h"
+#include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <stdexcept>
 
 using namespace std;
 
@@ -28,16 +30,12 @@ Color Image::get_pixel(unsigned x, unsigned y) const
     return (*this)(x, y);
 }
 
-// Handier accessors
-// Usage: color = img(x,y);
-//        img(x,y) = color;
-Color const&Image::operator()(unsigned x, unsigned y) const
+ImageView Image::view(Tile const &tile)
 {
-    return d_pixels.at(index(x, y));
-}
-Color &Image::operator()(unsigned x, unsigned y)
-{
-    return d_pixels.at(index(x, y));
+    assert(tile.x0 <= tile.x1 && tile.x1 <= d_width);
+    assert(tile.y0 <= tile.y1 && tile.y1 <= d_height);
+    return ImageView(d_pixels.data() + index(tile.x0, tile.y0), d_width,
+                     tile);
 }
 
 unsigned Image::width() const
@@ -59,28 +57,45 @@ unsigned Image::size() const
 // useful for texture access
 Color const &Image::colorAt(float x, float y) const
 {
-    return d_pixels.at(findex(x, y));
+    return d_pixels[findex(x, y)];
 }
 
-void Image::write_png(std::string const &filename) const
+vector<unsigned char> Image::encode_png(PngEncoder const &encoder) const
 {
-    vector<unsigned char> image;
-    image.reserve(size() * 4);  // reserves size (less allocations)
-    for (Color pixel : d_pixels)
+    // RGB, the alpha is always 1
+    vector<unsigned char> image(size() * 3);
+    unsigned char *dest = image.data();
+    for (Color const &pixel : d_pixels)
     {
-        image.push_back(static_cast<unsigned char>(pixel.r * 255.0));
-        image.push_back(static_cast<unsigned char>(pixel.g * 255.0));
-        image.push_back(static_cast<unsigned char>(pixel.b * 255.0));
-        image.push_back(255);   // alpha is always 1
+        *dest++ = static_cast<unsigned char>(pixel.r * 255.0);
+        *dest++ = static_cast<unsigned char>(pixel.g * 255.0);
+        *dest++ = static_cast<unsigned char>(pixel.b * 255.0);
     }
 
-    lodepng::encode(filename, image, d_width, d_height);
+    return encoder.encode(image.data(), d_width, d_height);
+}
+
+void Image::write_png(std::string const &filename,
+                      PngEncoder const &encoder) const
+{
+    unsigned error = lodepng::save_file(encode_png(encoder), filename);
+    if (error)
+        throw runtime_error("Could not write " + filename + ": "
+                            + lodepng_error_text(error));
 }
 
 void Image::read_png(std::string const &filename)
 {
     vector<unsigned char> image;
-    lodepng::decode(image, d_width, d_height, filename);
+    unsigned error = lodepng::decode(image, d_width, d_height, filename);
+    if (error)
+    {
+        d_width = d_height = 0;
+        d_pixels.clear();
+        throw runtime_error("Could not read " + filename + ": "
+                            + lodepng_error_text(error));
+    }
+    d_pixels.clear();
     d_pixels.reserve(size());
 
     auto imgIter = image.begin();
@@ -97,3 +112,24 @@ void Image::read_png(std::string const &filename)
         d_pixels.push_back(Color(r, g, b));
     }
 }
+
+void ImageView::copy(ImageView const &other) const
+{
+    assert(d_tile.x0 == other.d_tile.x0 && d_tile.x1 == other.d_tile.x1);
+    assert(d_tile.y0 == other.d_tile.y0 && d_tile.y1 == other.d_tile.y1);
+    unsigned width = d_tile.x1 - d_tile.x0;
+    for (unsigned row = 0; row != d_tile.y1 - d_tile.y0; ++row)
+        copy_n(other.d_pixels + row * other.d_stride, width,
+               d_pixels + row * d_stride);
+}
+
+ImageView TileBuffer::view(Tile const &tile)
+{
+    // a cache line of padding on either side of the pixels
+    size_t const pad = (64 + sizeof(Color) - 1) / sizeof(Color);
+    unsigned width = tile.x1 - tile.x0;
+    size_t area = size_t(width) * (tile.y1 - tile.y0);
+    if (d_pixels.size() < area + 2 * pad)
+        d_pixels.resize(area + 2 * pad);
+    return ImageView(d_pixels.data() + pad, width, tile);
+}
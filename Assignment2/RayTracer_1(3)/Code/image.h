@@ -1,11 +1,48 @@
 #ifndef IMAGE_H_
 #define IMAGE_H_
 
+#include "pngencoder.h"
+#include "tilescheduler.h"
 #include "triple.h"
 
+#include <cassert>
 #include <string>
 #include <vector>
 
+// A rectangle of pixels, addressed with the coordinates of the image it is
+// (or will be) part of. Like a span it does not own the pixels. Rendering
+// threads get views of disjoint tiles, so they can write without locking.
+// Access is only checked (by assert) in debug builds.
+class ImageView
+{
+    Color *d_pixels;        // pixel (x0, y0)
+    unsigned d_stride;      // pixels from one row to the next
+    Tile d_tile;
+
+    public:
+        ImageView(Color *pixels, unsigned stride, Tile const &tile);
+
+        Color &operator()(unsigned x, unsigned y) const;
+
+        Tile const &tile() const;
+
+        // copies the pixels of other, which covers the same tile
+        void copy(ImageView const &other) const;
+};
+
+// Pixels that only one thread writes to: a tile is rendered into the buffer
+// and copied into the image when it is done. The buffer does not share a
+// cache line with any other allocation, so threads rendering neighbouring
+// tiles do not invalidate each other's caches on every pixel.
+class TileBuffer
+{
+    std::vector<Color> d_pixels;
+
+    public:
+        // a view of the buffer as tile, the contents are undefined
+        ImageView view(Tile const &tile);
+};
+
 class Image
 {
     std::vector<Color> d_pixels;
@@ -26,6 +63,9 @@ class Image
         Color const &operator()(unsigned x, unsigned y) const;
         Color &operator()(unsigned x, unsigned y);
 
+        // the pixels of tile, which must lie within the image
+        ImageView view(Tile const &tile);
+
         unsigned width() const;
         unsigned height() const;
         unsigned size() const;
@@ -34,12 +74,21 @@ class Image
         // useful for texture access
         Color const &colorAt(float x, float y) const;
 
-        void write_png(std::string const &filename) const;
+        // the image as a PNG file, in memory or written to filename.
+        // write_png throws runtime_error if the file cannot be written.
+        std::vector<unsigned char> encode_png(
+            PngEncoder const &encoder = PngEncoder()) const;
+        void write_png(std::string const &filename,
+                       PngEncoder const &encoder = PngEncoder()) const;
+
+        // replaces the image by a PNG file, throws runtime_error if it
+        // cannot be read
         void read_png(std::string const &filename);
 
     private:
         inline unsigned index(unsigned x, unsigned y) const
         {
+            assert(x < d_width && y < d_height);
             return y * d_width + x;
         }
 
@@ -52,4 +101,33 @@ class Image
 
 };
 
+inline ImageView::ImageView(Color *pixels, unsigned stride, Tile const &tile)
+:
+    d_pixels(pixels),
+    d_stride(stride),
+    d_tile(tile)
+{}
+
+inline Color &ImageView::operator()(unsigned x, unsigned y) const
+{
+    assert(x >= d_tile.x0 && x < d_tile.x1);
+    assert(y >= d_tile.y0 && y < d_tile.y1);
+    return d_pixels[(y - d_tile.y0) * d_stride + (x - d_tile.x0)];
+}
+
+inline Tile const &ImageView::tile() const
+{
+    return d_tile;
+}
+
+inline Color const &Image::operator()(unsigned x, unsigned y) const
+{
+    return d_pixels[index(x, y)];
+}
+
+inline Color &Image::operator()(unsigned x, unsigned y)
+{
+    return d_pixels[index(x, y)];
+}
+
 #endif
@@ -0,0 +1,67 @@
+#ifndef KERNELS_H_
+#define KERNELS_H_
+
+// Low level intersection kernels working on raw arrays of reals. Every
+// kernel exists as a scalar version and as SSE2 and AVX2 versions, each
+// compiled in its own file with the matching instruction set enabled.
+// Which set is used is decided at run time, see simd.h.
+//
+// NOTE: the SIMD files must not use inline functions or templates from
+// other headers: the linker may pick their copy for the whole program.
+
+#include "real.h"
+
+// Structure-of-arrays view of a TriangleBuffer: v0 and the edges
+// e1 = v1 - v0 and e2 = v2 - v0, one array per component.
+struct TriangleArrays
+{
+    real const *v0[3];
+    real const *e1[3];
+    real const *e2[3];
+};
+
+// Intersects the ray O + t D with triangles [first, first + count). The
+// closest hit with INTERSECT_EPSILON < t < tMax lowers tMax and stores its
+// index in hitTri and its barycentric coordinates in hitU and hitV, true is
+// returned if there was such a hit. Results are identical to
+// Triangle::intersect for every instruction set.
+typedef bool (*TriangleKernel)(real const *O, real const *D,
+                               TriangleArrays const &tris,
+                               unsigned first, unsigned count,
+                               real &tMax, unsigned &hitTri,
+                               real &hitU, real &hitV);
+
+// Packets of rays are stored as O[axis][lane] and D[axis][lane]. The
+// packet kernels intersect the rays whose bit is set in mask with a single
+// primitive, store the distance of every ray in t and return the mask of
+// the rays that hit. Per ray, the result is that of the scalar intersect().
+unsigned const PACKET_SIZE = 4;
+
+// Sphere::intersect: hit when t > INTERSECT_EPSILON
+typedef unsigned (*SpherePacketKernel)(real const (*O)[PACKET_SIZE],
+                                       real const (*D)[PACKET_SIZE],
+                                       real const *center, real radius,
+                                       unsigned mask, real *t);
+
+// Triangle::intersect, the triangle given by v0 and its edges e1 and e2.
+// The barycentric coordinates of the hits are stored in u and v.
+typedef unsigned (*TrianglePacketKernel)(real const (*O)[PACKET_SIZE],
+                                         real const (*D)[PACKET_SIZE],
+                                         real const *v0, real const *e1,
+                                         real const *e2,
+                                         unsigned mask, real *t,
+                                         real *u, real *v);
+
+struct Kernels
+{
+    TriangleKernel intersectTriangles;
+    SpherePacketKernel intersectSpherePacket;
+    TrianglePacketKernel intersectTrianglePacket;
+};
+
+// nullptr when the file was compiled without support for the instruction set
+Kernels const *scalarKernels();
+Kernels const *sse2Kernels();
+Kernels const *avx2Kernels();
+
+#endif
@@ -0,0 +1,365 @@
+#include "kernels.h"
+
+// Compiled with AVX2 enabled (see CMakeLists.txt), only called when the cpu
+// supports it. Works on four triangles at a time in double precision and on
+// eight in single precision, with exactly the operations of the scalar
+// kernel so the results are bit-identical.
+
+#ifdef __AVX2__
+
+#include <immintrin.h>
+
+namespace
+{
+    // The triangle batch kernel is written once, for registers of type
+    // vreal and the overloads below: four doubles or eight floats.
+#ifdef RAY_SINGLE_PRECISION
+    typedef __m256 vreal;
+#else
+    typedef __m256d vreal;
+#endif
+    unsigned const WIDTH = sizeof(vreal) / sizeof(real);
+
+#define BINARY(name, op)                                                    \
+    inline __m256d name(__m256d a, __m256d b)                               \
+    {                                                                       \
+        return _mm256_##op##_pd(a, b);                                      \
+    }                                                                       \
+    inline __m256 name(__m256 a, __m256 b)                                  \
+    {                                                                       \
+        return _mm256_##op##_ps(a, b);                                      \
+    }
+
+    BINARY(add, add)
+    BINARY(sub, sub)
+    BINARY(mul, mul)
+    BINARY(div, div)
+    BINARY(bitAndNot, andnot)       // ~a & b
+    BINARY(bitOr, or)
+
+#undef BINARY
+
+    // ordered comparisons: false when either value is NaN
+    inline __m256d cmplt(__m256d a, __m256d b)
+    {
+        return _mm256_cmp_pd(a, b, _CMP_LT_OQ);
+    }
+
+    inline __m256 cmplt(__m256 a, __m256 b)
+    {
+        return _mm256_cmp_ps(a, b, _CMP_LT_OQ);
+    }
+
+    inline __m256d cmpgt(__m256d a, __m256d b)
+    {
+        return _mm256_cmp_pd(a, b, _CMP_GT_OQ);
+    }
+
+    inline __m256 cmpgt(__m256 a, __m256 b)
+    {
+        return _mm256_cmp_ps(a, b, _CMP_GT_OQ);
+    }
+
+    inline __m256d set1(double value)
+    {
+        return _mm256_set1_pd(value);
+    }
+
+    inline __m256 set1(float value)
+    {
+        return _mm256_set1_ps(value);
+    }
+
+    inline void store(double *values, __m256d a)
+    {
+        _mm256_storeu_pd(values, a);
+    }
+
+    inline void store(float *values, __m256 a)
+    {
+        _mm256_storeu_ps(values, a);
+    }
+
+    inline int movemask(__m256d a)
+    {
+        return _mm256_movemask_pd(a);
+    }
+
+    inline int movemask(__m256 a)
+    {
+        return _mm256_movemask_ps(a);
+    }
+
+    // the first count <= WIDTH values, the other lanes are zero and the
+    // memory behind them is not read
+    inline __m256d loadFirst(double const *values, unsigned count)
+    {
+        __m256i const mask = _mm256_cmpgt_epi64(_mm256_set1_epi64x(count),
+                                                _mm256_set_epi64x(3, 2, 1, 0));
+        return _mm256_maskload_pd(values, mask);
+    }
+
+    inline __m256 loadFirst(float const *values, unsigned count)
+    {
+        __m256i const mask = _mm256_cmpgt_epi32(
+                                _mm256_set1_epi32(count),
+                                _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+        return _mm256_maskload_ps(values, mask);
+    }
+
+    bool intersectTriangles(real const *O, real const *D,
+                            TriangleArrays const &tris,
+                            unsigned first, unsigned count,
+                            real &tMax, unsigned &hitTri,
+                            real &hitU, real &hitV)
+    {
+        vreal const eps = set1(INTERSECT_EPSILON);
+        vreal const zero = set1(real(0));
+        vreal const one = set1(real(1));
+        vreal const signBit = set1(real(-0.0));
+
+        vreal const Ox = set1(O[0]);
+        vreal const Oy = set1(O[1]);
+        vreal const Oz = set1(O[2]);
+        vreal const Dx = set1(D[0]);
+        vreal const Dy = set1(D[1]);
+        vreal const Dz = set1(D[2]);
+
+        bool found = false;
+        unsigned const last = first + count;
+
+        for (unsigned tri = first; tri < last; tri += WIDTH)
+        {
+            // The last group may be partial: only its valid lanes are read
+            unsigned const lanes = last - tri < WIDTH ? last - tri : WIDTH;
+            auto load = [&](real const *arr)
+            {
+                return loadFirst(arr + tri, lanes);
+            };
+
+            vreal const e1x = load(tris.e1[0]);
+            vreal const e1y = load(tris.e1[1]);
+            vreal const e1z = load(tris.e1[2]);
+            vreal const e2x = load(tris.e2[0]);
+            vreal const e2y = load(tris.e2[1]);
+            vreal const e2z = load(tris.e2[2]);
+
+            vreal Px = sub(mul(Dy, e2z), mul(Dz, e2y));
+            vreal Py = sub(mul(Dz, e2x), mul(Dx, e2z));
+            vreal Pz = sub(mul(Dx, e2y), mul(Dy, e2x));
+            vreal det = add(add(mul(e1x, Px), mul(e1y, Py)), mul(e1z, Pz));
+            vreal invDet = div(one, det);
+
+            vreal Tx = sub(Ox, load(tris.v0[0]));
+            vreal Ty = sub(Oy, load(tris.v0[1]));
+            vreal Tz = sub(Oz, load(tris.v0[2]));
+            vreal u = mul(add(add(mul(Tx, Px), mul(Ty, Py)), mul(Tz, Pz)),
+                          invDet);
+
+            vreal Qx = sub(mul(Ty, e1z), mul(Tz, e1y));
+            vreal Qy = sub(mul(Tz, e1x), mul(Tx, e1z));
+            vreal Qz = sub(mul(Tx, e1y), mul(Ty, e1x));
+            vreal v = mul(add(add(mul(Dx, Qx), mul(Dy, Qy)), mul(Dz, Qz)),
+                          invDet);
+            vreal t = mul(add(add(mul(e2x, Qx), mul(e2y, Qy)), mul(e2z, Qz)),
+                          invDet);
+
+            // The same tests as the scalar kernel: a NaN fails every
+            // (ordered) comparison, so it rejects nothing but is never
+            // accepted as t.
+            vreal reject = cmplt(bitAndNot(signBit, det), eps);
+            reject = bitOr(reject, cmplt(u, zero));
+            reject = bitOr(reject, cmpgt(u, one));
+            reject = bitOr(reject, cmpgt(add(v, u), one));
+            reject = bitOr(reject, cmplt(v, zero));
+            vreal accept = bitAndNot(reject, cmpgt(t, eps));
+
+            int mask = movemask(accept) & ((1 << lanes) - 1);
+            if (mask == 0)
+                continue;
+
+            // lanes in order, so on equal distances the first one wins
+            real tLane[WIDTH];
+            real uLane[WIDTH];
+            real vLane[WIDTH];
+            store(tLane, t);
+            store(uLane, u);
+            store(vLane, v);
+            for (unsigned lane = 0; lane != WIDTH; ++lane)
+            {
+                if ((mask >> lane & 1) && tLane[lane] < tMax)
+                {
+                    tMax = tLane[lane];
+                    hitTri = tri + lane;
+                    hitU = uLane[lane];
+                    hitV = vLane[lane];
+                    found = true;
+                }
+            }
+        }
+
+        return found;
+    }
+
+#ifndef RAY_SINGLE_PRECISION
+
+    // A packet of four doubles fills one AVX register. Four floats fill an
+    // SSE register, so in single precision the SSE2 packet kernels are used
+    // (see avx2Kernels()).
+    unsigned intersectSpherePacket(real const (*O)[PACKET_SIZE],
+                                   real const (*D)[PACKET_SIZE],
+                                   real const *center, real radius,
+                                   unsigned mask, real *t)
+    {
+        __m256d const eps = _mm256_set1_pd(INTERSECT_EPSILON);
+        __m256d const signBit = _mm256_set1_pd(-0.0);
+
+        __m256d const Dx = _mm256_loadu_pd(D[0]);
+        __m256d const Dy = _mm256_loadu_pd(D[1]);
+        __m256d const Dz = _mm256_loadu_pd(D[2]);
+        __m256d const Lx = _mm256_sub_pd(_mm256_loadu_pd(O[0]),
+                                         _mm256_set1_pd(center[0]));
+        __m256d const Ly = _mm256_sub_pd(_mm256_loadu_pd(O[1]),
+                                         _mm256_set1_pd(center[1]));
+        __m256d const Lz = _mm256_sub_pd(_mm256_loadu_pd(O[2]),
+                                         _mm256_set1_pd(center[2]));
+
+        __m256d A = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(Dx, Dx),
+                                                _mm256_mul_pd(Dy, Dy)),
+                                  _mm256_mul_pd(Dz, Dz));
+        __m256d B = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(Dx, Lx),
+                                                _mm256_mul_pd(Dy, Ly)),
+                                  _mm256_mul_pd(Dz, Lz));
+        __m256d C = _mm256_sub_pd(
+                        _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(Lx, Lx),
+                                                    _mm256_mul_pd(Ly, Ly)),
+                                      _mm256_mul_pd(Lz, Lz)),
+                        _mm256_set1_pd(radius * radius));
+        __m256d disc = _mm256_sqrt_pd(_mm256_sub_pd(_mm256_mul_pd(B, B),
+                                                    _mm256_mul_pd(A, C)));
+
+        // nearest root in front of the ray, as in Sphere::intersect
+        __m256d negB = _mm256_xor_pd(B, signBit);
+        __m256d t1 = _mm256_div_pd(_mm256_add_pd(negB, disc), A);
+        __m256d t2 = _mm256_div_pd(_mm256_sub_pd(negB, disc), A);
+        __m256d near = _mm256_blendv_pd(t1, t2,
+                                        _mm256_cmp_pd(t2, t1, _CMP_LT_OQ));
+        __m256d far = _mm256_blendv_pd(t1, t2,
+                                       _mm256_cmp_pd(t1, t2, _CMP_LT_OQ));
+        __m256d dist = _mm256_blendv_pd(far, near,
+                                        _mm256_cmp_pd(near, eps, _CMP_GT_OQ));
+
+        _mm256_storeu_pd(t, dist);
+        return _mm256_movemask_pd(_mm256_cmp_pd(dist, eps, _CMP_GT_OQ))
+               & mask;
+    }
+
+    unsigned intersectTrianglePacket(real const (*O)[PACKET_SIZE],
+                                     real const (*D)[PACKET_SIZE],
+                                     real const *v0, real const *e1,
+                                     real const *e2,
+                                     unsigned mask, real *t,
+                                     real *uOut, real *vOut)
+    {
+        __m256d const eps = _mm256_set1_pd(INTERSECT_EPSILON);
+        __m256d const zero = _mm256_setzero_pd();
+        __m256d const one = _mm256_set1_pd(1.0);
+        __m256d const signBit = _mm256_set1_pd(-0.0);
+
+        __m256d const Dx = _mm256_loadu_pd(D[0]);
+        __m256d const Dy = _mm256_loadu_pd(D[1]);
+        __m256d const Dz = _mm256_loadu_pd(D[2]);
+        __m256d const e1x = _mm256_set1_pd(e1[0]);
+        __m256d const e1y = _mm256_set1_pd(e1[1]);
+        __m256d const e1z = _mm256_set1_pd(e1[2]);
+        __m256d const e2x = _mm256_set1_pd(e2[0]);
+        __m256d const e2y = _mm256_set1_pd(e2[1]);
+        __m256d const e2z = _mm256_set1_pd(e2[2]);
+
+        __m256d Px = _mm256_sub_pd(_mm256_mul_pd(Dy, e2z),
+                                   _mm256_mul_pd(Dz, e2y));
+        __m256d Py = _mm256_sub_pd(_mm256_mul_pd(Dz, e2x),
+                                   _mm256_mul_pd(Dx, e2z));
+        __m256d Pz = _mm256_sub_pd(_mm256_mul_pd(Dx, e2y),
+                                   _mm256_mul_pd(Dy, e2x));
+        __m256d det = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(e1x, Px),
+                                                  _mm256_mul_pd(e1y, Py)),
+                                    _mm256_mul_pd(e1z, Pz));
+        __m256d invDet = _mm256_div_pd(one, det);
+
+        __m256d Tx = _mm256_sub_pd(_mm256_loadu_pd(O[0]),
+                                   _mm256_set1_pd(v0[0]));
+        __m256d Ty = _mm256_sub_pd(_mm256_loadu_pd(O[1]),
+                                   _mm256_set1_pd(v0[1]));
+        __m256d Tz = _mm256_sub_pd(_mm256_loadu_pd(O[2]),
+                                   _mm256_set1_pd(v0[2]));
+        __m256d u = _mm256_mul_pd(
+                        _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(Tx, Px),
+                                                    _mm256_mul_pd(Ty, Py)),
+                                      _mm256_mul_pd(Tz, Pz)),
+                        invDet);
+
+        __m256d Qx = _mm256_sub_pd(_mm256_mul_pd(Ty, e1z),
+                                   _mm256_mul_pd(Tz, e1y));
+        __m256d Qy = _mm256_sub_pd(_mm256_mul_pd(Tz, e1x),
+                                   _mm256_mul_pd(Tx, e1z));
+        __m256d Qz = _mm256_sub_pd(_mm256_mul_pd(Tx, e1y),
+                                   _mm256_mul_pd(Ty, e1x));
+        __m256d v = _mm256_mul_pd(
+                        _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(Dx, Qx),
+                                                    _mm256_mul_pd(Dy, Qy)),
+                                      _mm256_mul_pd(Dz, Qz)),
+                        invDet);
+        __m256d dist = _mm256_mul_pd(
+                        _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(e2x, Qx),
+                                                    _mm256_mul_pd(e2y, Qy)),
+                                      _mm256_mul_pd(e2z, Qz)),
+                        invDet);
+
+        __m256d absDet = _mm256_andnot_pd(signBit, det);
+        __m256d reject = _mm256_cmp_pd(absDet, eps, _CMP_LT_OQ);
+        reject = _mm256_or_pd(reject, _mm256_cmp_pd(u, zero, _CMP_LT_OQ));
+        reject = _mm256_or_pd(reject, _mm256_cmp_pd(u, one, _CMP_GT_OQ));
+        reject = _mm256_or_pd(reject, _mm256_cmp_pd(_mm256_add_pd(v, u),
+                                                    one, _CMP_GT_OQ));
+        reject = _mm256_or_pd(reject, _mm256_cmp_pd(v, zero, _CMP_LT_OQ));
+        __m256d accept = _mm256_andnot_pd(reject,
+                                _mm256_cmp_pd(dist, eps, _CMP_GT_OQ));
+
+        _mm256_storeu_pd(t, dist);
+        _mm256_storeu_pd(uOut, u);
+        _mm256_storeu_pd(vOut, v);
+        return _mm256_movemask_pd(accept) & mask;
+    }
+
+    Kernels const KERNELS = {
+        intersectTriangles,
+        intersectSpherePacket,
+        intersectTrianglePacket
+    };
+
+#endif
+}
+
+Kernels const *avx2Kernels()
+{
+#ifdef RAY_SINGLE_PRECISION
+    static Kernels const kernels = {
+        intersectTriangles,
+        sse2Kernels()->intersectSpherePacket,
+        sse2Kernels()->intersectTrianglePacket
+    };
+    return &kernels;
+#else
+    return &KERNELS;
+#endif
+}
+
+#else
+
+Kernels const *avx2Kernels()
+{
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,145 @@
+#include "kernels.h"
+
+#include <cmath>
+
+using namespace std;
+
+namespace
+{
+    // Moller-Trumbore test of Triangle::intersect, the distance and the
+    // barycentric coordinates are stored in t, u and v when the ray hits
+    inline bool hitTriangle(real const *O, real const *D,
+                            real const *v0, real const *e1,
+                            real const *e2, real &t, real &u, real &v)
+    {
+        // P = D x e2, det = e1 . P
+        real Px = D[1] * e2[2] - D[2] * e2[1];
+        real Py = D[2] * e2[0] - D[0] * e2[2];
+        real Pz = D[0] * e2[1] - D[1] * e2[0];
+        real det = e1[0] * Px + e1[1] * Py + e1[2] * Pz;
+
+        // ray parallel to the triangle's plane
+        if (fabs(det) < INTERSECT_EPSILON)
+            return false;
+
+        real invDet = real(1) / det;
+
+        // T = O - v0, u = (T . P) / det
+        real Tx = O[0] - v0[0];
+        real Ty = O[1] - v0[1];
+        real Tz = O[2] - v0[2];
+        u = (Tx * Px + Ty * Py + Tz * Pz) * invDet;
+        if (u < 0 || u > 1)
+            return false;
+
+        // Q = T x e1, v = (D . Q) / det
+        real Qx = Ty * e1[2] - Tz * e1[1];
+        real Qy = Tz * e1[0] - Tx * e1[2];
+        real Qz = Tx * e1[1] - Ty * e1[0];
+        v = (D[0] * Qx + D[1] * Qy + D[2] * Qz) * invDet;
+        if (v + u > 1 || v < 0)
+            return false;
+
+        t = (e2[0] * Qx + e2[1] * Qy + e2[2] * Qz) * invDet;
+        return t > INTERSECT_EPSILON;
+    }
+
+    bool intersectTriangles(real const *O, real const *D,
+                            TriangleArrays const &tris,
+                            unsigned first, unsigned count,
+                            real &tMax, unsigned &hitTri,
+                            real &hitU, real &hitV)
+    {
+        bool found = false;
+
+        for (unsigned tri = first; tri != first + count; ++tri)
+        {
+            real const v0[3] = { tris.v0[0][tri], tris.v0[1][tri],
+                                 tris.v0[2][tri] };
+            real const e1[3] = { tris.e1[0][tri], tris.e1[1][tri],
+                                 tris.e1[2][tri] };
+            real const e2[3] = { tris.e2[0][tri], tris.e2[1][tri],
+                                 tris.e2[2][tri] };
+
+            real t;
+            real u;
+            real v;
+            if (hitTriangle(O, D, v0, e1, e2, t, u, v) && t < tMax)
+            {
+                tMax = t;
+                hitTri = tri;
+                hitU = u;
+                hitV = v;
+                found = true;
+            }
+        }
+
+        return found;
+    }
+
+    unsigned intersectSpherePacket(real const (*O)[PACKET_SIZE],
+                                   real const (*D)[PACKET_SIZE],
+                                   real const *center, real radius,
+                                   unsigned mask, real *t)
+    {
+        unsigned hits = 0;
+        for (unsigned lane = 0; lane != PACKET_SIZE; ++lane)
+        {
+            if (!(mask >> lane & 1))
+                continue;
+
+            real Lx = O[0][lane] - center[0];   // L = O - center
+            real Ly = O[1][lane] - center[1];
+            real Lz = O[2][lane] - center[2];
+            real A = D[0][lane] * D[0][lane] + D[1][lane] * D[1][lane]
+                   + D[2][lane] * D[2][lane];
+            real B = D[0][lane] * Lx + D[1][lane] * Ly + D[2][lane] * Lz;
+            real C = (Lx * Lx + Ly * Ly + Lz * Lz) - radius * radius;
+            real disc = sqrt(B * B - A * C);
+
+            // nearest root in front of the ray, as in Sphere::intersect
+            real t1 = (-B + disc) / A;
+            real t2 = (-B - disc) / A;
+            real near = t2 < t1 ? t2 : t1;
+            real far = t1 < t2 ? t2 : t1;
+            t[lane] = near > INTERSECT_EPSILON ? near : far;
+
+            if (t[lane] > INTERSECT_EPSILON)
+                hits |= 1 << lane;
+        }
+        return hits;
+    }
+
+    unsigned intersectTrianglePacket(real const (*O)[PACKET_SIZE],
+                                     real const (*D)[PACKET_SIZE],
+                                     real const *v0, real const *e1,
+                                     real const *e2,
+                                     unsigned mask, real *t,
+                                     real *u, real *v)
+    {
+        unsigned hits = 0;
+        for (unsigned lane = 0; lane != PACKET_SIZE; ++lane)
+        {
+            if (!(mask >> lane & 1))
+                continue;
+
+            real const rayO[3] = { O[0][lane], O[1][lane], O[2][lane] };
+            real const rayD[3] = { D[0][lane], D[1][lane], D[2][lane] };
+            if (hitTriangle(rayO, rayD, v0, e1, e2, t[lane], u[lane],
+                            v[lane]))
+                hits |= 1 << lane;
+        }
+        return hits;
+    }
+
+    Kernels const KERNELS = {
+        intersectTriangles,
+        intersectSpherePacket,
+        intersectTrianglePacket
+    };
+}
+
+Kernels const *scalarKernels()
+{
+    return &KERNELS;
+}
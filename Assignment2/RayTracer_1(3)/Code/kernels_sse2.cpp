@@ -0,0 +1,320 @@
+#include "kernels.h"
+
+// Compiled with SSE2 enabled (the x86-64 baseline). Works on one register of
+// WIDTH values at a time, two doubles or four floats (see real.h), with
+// exactly the operations of the scalar kernel so the results are
+// bit-identical.
+
+#ifdef __SSE2__
+
+#include <emmintrin.h>
+
+namespace
+{
+    // The kernels are written once, for registers of type vreal and the
+    // overloads below.
+#ifdef RAY_SINGLE_PRECISION
+    typedef __m128 vreal;
+#else
+    typedef __m128d vreal;
+#endif
+    unsigned const WIDTH = sizeof(vreal) / sizeof(real);
+
+#define BINARY(name, op)                                                    \
+    inline __m128d name(__m128d a, __m128d b) { return _mm_##op##_pd(a, b); } \
+    inline __m128 name(__m128 a, __m128 b) { return _mm_##op##_ps(a, b); }
+
+    BINARY(add, add)
+    BINARY(sub, sub)
+    BINARY(mul, mul)
+    BINARY(div, div)
+    BINARY(bitAnd, and)
+    BINARY(bitAndNot, andnot)       // ~a & b
+    BINARY(bitOr, or)
+    BINARY(bitXor, xor)
+    BINARY(cmplt, cmplt)
+    BINARY(cmpgt, cmpgt)
+
+#undef BINARY
+
+    inline __m128d set1(double value)
+    {
+        return _mm_set1_pd(value);
+    }
+
+    inline __m128 set1(float value)
+    {
+        return _mm_set1_ps(value);
+    }
+
+    inline __m128d load(double const *values)
+    {
+        return _mm_loadu_pd(values);
+    }
+
+    inline __m128 load(float const *values)
+    {
+        return _mm_loadu_ps(values);
+    }
+
+    inline void store(double *values, __m128d a)
+    {
+        _mm_storeu_pd(values, a);
+    }
+
+    inline void store(float *values, __m128 a)
+    {
+        _mm_storeu_ps(values, a);
+    }
+
+    inline __m128d squareRoot(__m128d a)
+    {
+        return _mm_sqrt_pd(a);
+    }
+
+    inline __m128 squareRoot(__m128 a)
+    {
+        return _mm_sqrt_ps(a);
+    }
+
+    inline int movemask(__m128d a)
+    {
+        return _mm_movemask_pd(a);
+    }
+
+    inline int movemask(__m128 a)
+    {
+        return _mm_movemask_ps(a);
+    }
+
+    // the first count < WIDTH values, the other lanes are zero
+    inline vreal loadFirst(real const *values, unsigned count)
+    {
+        real padded[WIDTH] = {};
+        for (unsigned lane = 0; lane != count; ++lane)
+            padded[lane] = values[lane];
+        return load(padded);
+    }
+
+    // SSE2 has no blend instruction: mask ? b : a
+    inline vreal select(vreal mask, vreal a, vreal b)
+    {
+        return bitOr(bitAnd(mask, b), bitAndNot(mask, a));
+    }
+
+    bool intersectTriangles(real const *O, real const *D,
+                            TriangleArrays const &tris,
+                            unsigned first, unsigned count,
+                            real &tMax, unsigned &hitTri,
+                            real &hitU, real &hitV)
+    {
+        vreal const eps = set1(INTERSECT_EPSILON);
+        vreal const zero = set1(real(0));
+        vreal const one = set1(real(1));
+        vreal const signBit = set1(real(-0.0));
+
+        vreal const Ox = set1(O[0]);
+        vreal const Oy = set1(O[1]);
+        vreal const Oz = set1(O[2]);
+        vreal const Dx = set1(D[0]);
+        vreal const Dy = set1(D[1]);
+        vreal const Dz = set1(D[2]);
+
+        bool found = false;
+        unsigned const last = first + count;
+
+        for (unsigned tri = first; tri < last; tri += WIDTH)
+        {
+            // Only the valid lanes of the last group are loaded, the others
+            // are masked off below.
+            unsigned const lanes = last - tri < WIDTH ? last - tri : WIDTH;
+            auto loadGroup = [&](real const *arr)
+            {
+                return lanes == WIDTH ? load(arr + tri)
+                                      : loadFirst(arr + tri, lanes);
+            };
+
+            vreal const e1x = loadGroup(tris.e1[0]);
+            vreal const e1y = loadGroup(tris.e1[1]);
+            vreal const e1z = loadGroup(tris.e1[2]);
+            vreal const e2x = loadGroup(tris.e2[0]);
+            vreal const e2y = loadGroup(tris.e2[1]);
+            vreal const e2z = loadGroup(tris.e2[2]);
+
+            vreal Px = sub(mul(Dy, e2z), mul(Dz, e2y));
+            vreal Py = sub(mul(Dz, e2x), mul(Dx, e2z));
+            vreal Pz = sub(mul(Dx, e2y), mul(Dy, e2x));
+            vreal det = add(add(mul(e1x, Px), mul(e1y, Py)), mul(e1z, Pz));
+            vreal invDet = div(one, det);
+
+            vreal Tx = sub(Ox, loadGroup(tris.v0[0]));
+            vreal Ty = sub(Oy, loadGroup(tris.v0[1]));
+            vreal Tz = sub(Oz, loadGroup(tris.v0[2]));
+            vreal u = mul(add(add(mul(Tx, Px), mul(Ty, Py)), mul(Tz, Pz)),
+                          invDet);
+
+            vreal Qx = sub(mul(Ty, e1z), mul(Tz, e1y));
+            vreal Qy = sub(mul(Tz, e1x), mul(Tx, e1z));
+            vreal Qz = sub(mul(Tx, e1y), mul(Ty, e1x));
+            vreal v = mul(add(add(mul(Dx, Qx), mul(Dy, Qy)), mul(Dz, Qz)),
+                          invDet);
+            vreal t = mul(add(add(mul(e2x, Qx), mul(e2y, Qy)), mul(e2z, Qz)),
+                          invDet);
+
+            // The same tests as the scalar kernel: a NaN fails every
+            // comparison, so it rejects nothing but is never accepted as t.
+            vreal reject = cmplt(bitAndNot(signBit, det), eps);
+            reject = bitOr(reject, cmplt(u, zero));
+            reject = bitOr(reject, cmpgt(u, one));
+            reject = bitOr(reject, cmpgt(add(v, u), one));
+            reject = bitOr(reject, cmplt(v, zero));
+            vreal accept = bitAndNot(reject, cmpgt(t, eps));
+
+            int mask = movemask(accept) & ((1 << lanes) - 1);
+            if (mask == 0)
+                continue;
+
+            // lanes in order, so on equal distances the first one wins
+            real tLane[WIDTH];
+            real uLane[WIDTH];
+            real vLane[WIDTH];
+            store(tLane, t);
+            store(uLane, u);
+            store(vLane, v);
+            for (unsigned lane = 0; lane != WIDTH; ++lane)
+            {
+                if ((mask >> lane & 1) && tLane[lane] < tMax)
+                {
+                    tMax = tLane[lane];
+                    hitTri = tri + lane;
+                    hitU = uLane[lane];
+                    hitV = vLane[lane];
+                    found = true;
+                }
+            }
+        }
+
+        return found;
+    }
+
+    unsigned intersectSpherePacket(real const (*O)[PACKET_SIZE],
+                                   real const (*D)[PACKET_SIZE],
+                                   real const *center, real radius,
+                                   unsigned mask, real *t)
+    {
+        vreal const eps = set1(INTERSECT_EPSILON);
+        vreal const signBit = set1(real(-0.0));
+        vreal const rr = set1(radius * radius);
+
+        unsigned hits = 0;
+        for (unsigned lane = 0; lane != PACKET_SIZE; lane += WIDTH)
+        {
+            vreal const Dx = load(D[0] + lane);
+            vreal const Dy = load(D[1] + lane);
+            vreal const Dz = load(D[2] + lane);
+            vreal const Lx = sub(load(O[0] + lane), set1(center[0]));
+            vreal const Ly = sub(load(O[1] + lane), set1(center[1]));
+            vreal const Lz = sub(load(O[2] + lane), set1(center[2]));
+
+            vreal A = add(add(mul(Dx, Dx), mul(Dy, Dy)), mul(Dz, Dz));
+            vreal B = add(add(mul(Dx, Lx), mul(Dy, Ly)), mul(Dz, Lz));
+            vreal C = sub(add(add(mul(Lx, Lx), mul(Ly, Ly)), mul(Lz, Lz)),
+                          rr);
+            vreal disc = squareRoot(sub(mul(B, B), mul(A, C)));
+
+            // nearest root in front of the ray, as in Sphere::intersect
+            vreal negB = bitXor(B, signBit);
+            vreal t1 = div(add(negB, disc), A);
+            vreal t2 = div(sub(negB, disc), A);
+            vreal near = select(cmplt(t2, t1), t1, t2);
+            vreal far = select(cmplt(t1, t2), t1, t2);
+            vreal dist = select(cmpgt(near, eps), far, near);
+
+            store(t + lane, dist);
+            hits |= movemask(cmpgt(dist, eps)) << lane;
+        }
+        return hits & mask;
+    }
+
+    unsigned intersectTrianglePacket(real const (*O)[PACKET_SIZE],
+                                     real const (*D)[PACKET_SIZE],
+                                     real const *v0, real const *e1,
+                                     real const *e2,
+                                     unsigned mask, real *t,
+                                     real *uOut, real *vOut)
+    {
+        vreal const eps = set1(INTERSECT_EPSILON);
+        vreal const zero = set1(real(0));
+        vreal const one = set1(real(1));
+        vreal const signBit = set1(real(-0.0));
+
+        vreal const e1x = set1(e1[0]);
+        vreal const e1y = set1(e1[1]);
+        vreal const e1z = set1(e1[2]);
+        vreal const e2x = set1(e2[0]);
+        vreal const e2y = set1(e2[1]);
+        vreal const e2z = set1(e2[2]);
+
+        unsigned hits = 0;
+        for (unsigned lane = 0; lane != PACKET_SIZE; lane += WIDTH)
+        {
+            vreal const Dx = load(D[0] + lane);
+            vreal const Dy = load(D[1] + lane);
+            vreal const Dz = load(D[2] + lane);
+
+            vreal Px = sub(mul(Dy, e2z), mul(Dz, e2y));
+            vreal Py = sub(mul(Dz, e2x), mul(Dx, e2z));
+            vreal Pz = sub(mul(Dx, e2y), mul(Dy, e2x));
+            vreal det = add(add(mul(e1x, Px), mul(e1y, Py)), mul(e1z, Pz));
+            vreal invDet = div(one, det);
+
+            vreal Tx = sub(load(O[0] + lane), set1(v0[0]));
+            vreal Ty = sub(load(O[1] + lane), set1(v0[1]));
+            vreal Tz = sub(load(O[2] + lane), set1(v0[2]));
+            vreal u = mul(add(add(mul(Tx, Px), mul(Ty, Py)), mul(Tz, Pz)),
+                          invDet);
+
+            vreal Qx = sub(mul(Ty, e1z), mul(Tz, e1y));
+            vreal Qy = sub(mul(Tz, e1x), mul(Tx, e1z));
+            vreal Qz = sub(mul(Tx, e1y), mul(Ty, e1x));
+            vreal v = mul(add(add(mul(Dx, Qx), mul(Dy, Qy)), mul(Dz, Qz)),
+                          invDet);
+            vreal dist = mul(add(add(mul(e2x, Qx), mul(e2y, Qy)),
+                                 mul(e2z, Qz)),
+                             invDet);
+
+            vreal reject = cmplt(bitAndNot(signBit, det), eps);
+            reject = bitOr(reject, cmplt(u, zero));
+            reject = bitOr(reject, cmpgt(u, one));
+            reject = bitOr(reject, cmpgt(add(v, u), one));
+            reject = bitOr(reject, cmplt(v, zero));
+            vreal accept = bitAndNot(reject, cmpgt(dist, eps));
+
+            store(t + lane, dist);
+            store(uOut + lane, u);
+            store(vOut + lane, v);
+            hits |= movemask(accept) << lane;
+        }
+        return hits & mask;
+    }
+
+    Kernels const KERNELS = {
+        intersectTriangles,
+        intersectSpherePacket,
+        intersectTrianglePacket
+    };
+}
+
+Kernels const *sse2Kernels()
+{
+    return &KERNELS;
+}
+
+#else
+
+Kernels const *sse2Kernels()
+{
+    return nullptr;
+}
+
+#endif
@@ -3,6 +3,8 @@
 
 #include "triple.h"
 
+#include <limits>
+
 // Declare LightPtr for use in Scene class
 #include <memory>
 class Light;
@@ -14,10 +16,22 @@ class Light
         Point const position;
         Color const color;
 
-        Light(Point const &pos, Color const &c)
+        // The color is divided by constant + linear * d + quadratic * d^2
+        // at distance d. The default (1, 0, 0) is no attenuation.
+        Triple const attenuation;
+
+        // Influence radius: the light fades out smoothly towards it and
+        // has no effect beyond it. Infinite by default.
+        double const radius;
+
+        Light(Point const &pos, Color const &c,
+              Triple const &atten = Triple(1, 0, 0),
+              double r = std::numeric_limits<double>::infinity())
         :
             position(pos),
-            color(c)
+            color(c),
+            attenuation(atten),
+            radius(r)
         {}
 };
 
@@ -0,0 +1,70 @@
+#include "lightarray.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+void LightArray::add(Light const &light)
+{
+    d_unbounded.push_back(d_x.size());
+
+    d_x.push_back(light.position.x);
+    d_y.push_back(light.position.y);
+    d_z.push_back(light.position.z);
+    d_r.push_back(light.color.r);
+    d_g.push_back(light.color.g);
+    d_b.push_back(light.color.b);
+    d_constant.push_back(light.attenuation.x);
+    d_linear.push_back(light.attenuation.y);
+    d_quadratic.push_back(light.attenuation.z);
+    d_range.push_back(light.radius);
+    d_radius2.push_back(numeric_limits<real>::infinity());
+}
+
+void LightArray::build(double cutoff)
+{
+    d_unbounded.clear();
+    d_bounded.clear();
+
+    vector<BBox> spheres;
+    for (size_t idx = 0; idx != size(); ++idx)
+    {
+        double radius = influenceRadius(idx, cutoff);
+        d_radius2[idx] = radius * radius;
+        if (isinf(radius))
+            d_unbounded.push_back(idx);
+        else if (radius > 0)
+        {
+            d_bounded.push_back(idx);
+            Vector extent(radius, radius, radius);
+            spheres.emplace_back(position(idx) - extent,
+                                 position(idx) + extent);
+        }
+    }
+    d_bvh.build(spheres);
+}
+
+double LightArray::influenceRadius(size_t idx, double cutoff) const
+{
+    if (cutoff <= 0)
+        return d_range[idx];
+
+    // the attenuation at which the brightest channel drops to cutoff
+    double limit = max({ d_r[idx], d_g[idx], d_b[idx] }) / cutoff;
+    double constant = d_constant[idx];
+    double linear = d_linear[idx];
+    double quadratic = d_quadratic[idx];
+
+    if (constant >= limit)                  // below cutoff everywhere
+        return 0.0;
+    if (quadratic > 0)                      // root of the quadratic
+        return min(d_range[idx],
+                   (-linear + sqrt(linear * linear
+                                   + 4 * quadratic * (limit - constant)))
+                   / (2 * quadratic));
+    if (linear > 0)
+        return min(d_range[idx], (limit - constant) / linear);
+    return d_range[idx];
+}
@@ -0,0 +1,118 @@
+#ifndef LIGHTARRAY_H_
+#define LIGHTARRAY_H_
+
+#include "bvh.h"
+#include "light.h"
+#include "triple.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// The lights of a scene as a structure of arrays: one array per coordinate
+// of the positions and per channel of the colors. The shading loop runs over
+// the lights at every hit, and reads them in order from a few dense arrays
+// instead of through a pointer per light.
+//
+// Lights with a radius, and attenuated lights when there is a cutoff (see
+// build()), have a sphere of influence outside which they are skipped. These
+// lights are indexed by a BVH over their spheres, so a hit only visits the
+// lights that can reach it.
+class LightArray
+{
+    std::vector<real> d_x;          // positions
+    std::vector<real> d_y;
+    std::vector<real> d_z;
+    std::vector<real> d_r;          // colors
+    std::vector<real> d_g;
+    std::vector<real> d_b;
+    std::vector<real> d_constant;   // attenuation
+    std::vector<real> d_linear;
+    std::vector<real> d_quadratic;
+    std::vector<double> d_range;    // Light::radius
+    std::vector<real> d_radius2;    // influence radius squared
+
+    std::vector<unsigned> d_unbounded;  // lights that reach every point
+    std::vector<unsigned> d_bounded;    // the others, primitives of d_bvh
+    BVH d_bvh;                          // over the spheres of d_bounded
+
+    public:
+        void add(Light const &light);
+
+        // Computes the influence radius of every light: its radius, or the
+        // distance from which on its attenuated color stays below cutoff in
+        // every channel if that is smaller. Skipping a light beyond it
+        // changes a channel by at most cutoff (times kd + ks). Lights with
+        // an infinite radius are visited at every point, the others are
+        // indexed, and lights that never reach the cutoff are dropped.
+        // Until build() is called every light is visited everywhere.
+        void build(double cutoff);
+
+        size_t size() const;
+
+        Point position(size_t idx) const;
+        Color color(size_t idx) const;
+
+        // the factor of the color of light idx at distance dist
+        double attenuation(size_t idx, double dist) const;
+
+        // Calls visit(idx) for every light that reaches p: first the
+        // unbounded lights in the order they were added, then the indexed
+        // lights whose sphere of influence contains p.
+        template <typename Visitor>
+        void visit(Point const &p, Visitor &&visit) const;
+
+    private:
+        double influenceRadius(size_t idx, double cutoff) const;
+};
+
+inline size_t LightArray::size() const
+{
+    return d_x.size();
+}
+
+inline Point LightArray::position(size_t idx) const
+{
+    return Point(d_x[idx], d_y[idx], d_z[idx]);
+}
+
+inline Color LightArray::color(size_t idx) const
+{
+    return Color(d_r[idx], d_g[idx], d_b[idx]);
+}
+
+inline double LightArray::attenuation(size_t idx, double dist) const
+{
+    double atten = 1.0 / (d_constant[idx]
+                          + (d_linear[idx] + d_quadratic[idx] * dist) * dist);
+    if (std::isinf(d_range[idx]))
+        return atten;
+
+    // windowed by (1 - (dist / radius)^4)^2, which is 0 at the radius
+    double x = dist / d_range[idx];
+    double window = std::max(0.0, 1.0 - x * x * x * x);
+    return atten * window * window;
+}
+
+template <typename Visitor>
+void LightArray::visit(Point const &p, Visitor &&visit) const
+{
+    for (unsigned idx : d_unbounded)
+        visit(idx);
+
+    std::vector<unsigned> const &order = d_bvh.indices();
+    d_bvh.query(p, [&](unsigned first, unsigned count)
+    {
+        for (unsigned leaf = first; leaf != first + count; ++leaf)
+        {
+            unsigned idx = d_bounded[order[leaf]];
+            real dx = d_x[idx] - p.x;
+            real dy = d_y[idx] - p.y;
+            real dz = d_z[idx] - p.z;
+            if (dx * dx + dy * dy + dz * dz <= d_radius2[idx])
+                visit(idx);
+        }
+    });
+}
+
+#endif
@@ -1,39 +1,170 @@
+#include "pngencoder.h"
 #include "raytracer.h"
+#include "rendersettings.h"
+#include "simd.h"
 
+#include <climits>
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
 #include <string>
 
 using namespace std;
 
+namespace
+{
+    void usage(char const *prog)
+    {
+        cerr << "Usage: " << prog << " [options] in-file [out-file.png]\n"
+                "Options:\n"
+                "  -t, --threads N   render on N threads "
+                                    "(default: all hardware threads)\n"
+                "  --tile-size N     render in tiles of N x N pixels "
+                                    "(default: 16)\n"
+                "  --simd LEVEL      use the scalar, sse2 or avx2 kernels "
+                                    "(default: best supported)\n"
+                "  --no-packets      trace primary rays one by one instead "
+                                    "of in 2x2 packets\n"
+                "  --thread-buffers  render every tile into a buffer of "
+                                    "the thread first\n"
+                "  --no-mesh-cache   always parse .obj models, do not read "
+                                    "or write .rtmesh files\n"
+                "  --compact-vertices\n"
+                "                    store mesh vertex normals and texture "
+                                    "coordinates in 4 bytes\n"
+                "  --texture-format F\n"
+                "                    store textures as rgba8 (default) or "
+                                    "half floats\n"
+                "  --texture-filter F\n"
+                "                    filter textures bilinear or trilinear "
+                                    "(default)\n"
+                "  --progressive     render coarse to fine and write "
+                                    "snapshots of the image\n"
+                "  --snapshot-interval S\n"
+                "                    seconds between two snapshots "
+                                    "(default: 5)\n"
+                "  --png-level N     compress the image from 0 (fastest) "
+                                    "to 9 (smallest, default: 6)\n"
+                "  --stats FILE      write render statistics as JSON to "
+                                    "FILE\n";
+    }
+
+    unsigned parseCount(string const &option, char const *value)
+    {
+        // stoul accepts a sign and wraps negative numbers around
+        bool negative = value[strspn(value, " \t")] == '-';
+        unsigned long count = negative ? 0 : stoul(value);
+        if (count == 0 || count > UINT_MAX)
+            throw invalid_argument(option + " needs a positive number");
+        return count;
+    }
+}
+
 int main(int argc, char *argv[])
+try
 {
     cout << "Computer Graphics - Ray tracer\n\n";
 
-    if (argc < 2 || argc > 3)
+    RenderSettings settings;
+    string files[2];
+    unsigned numFiles = 0;
+
+    for (int idx = 1; idx < argc; ++idx)
     {
-        cerr << "Usage: " << argv[0] << " in-file [out-file.png]\n";
+        string arg = argv[idx];
+        bool hasValue = idx + 1 < argc;
+
+        if ((arg == "-t" || arg == "--threads") && hasValue)
+            settings.numThreads = parseCount(arg, argv[++idx]);
+        else if (arg == "--tile-size" && hasValue)
+            settings.tileSize = parseCount(arg, argv[++idx]);
+        else if (arg == "--no-packets")
+            settings.packets = false;
+        else if (arg == "--thread-buffers")
+            settings.threadBuffers = true;
+        else if (arg == "--no-mesh-cache")
+            settings.meshCache = false;
+        else if (arg == "--compact-vertices")
+            settings.compactVertices = true;
+        else if (arg == "--texture-format" && hasValue)
+        {
+            string format = argv[++idx];
+            if (format != "rgba8" && format != "half")
+                throw invalid_argument(arg + " needs rgba8 or half");
+            settings.textureFormat = format == "half" ? Texture::HALF
+                                                     : Texture::RGBA8;
+        }
+        else if (arg == "--texture-filter" && hasValue)
+        {
+            string filter = argv[++idx];
+            if (filter != "bilinear" && filter != "trilinear")
+                throw invalid_argument(arg + " needs bilinear or "
+                                       "trilinear");
+            settings.textureFilter = filter == "bilinear"
+                                     ? Texture::BILINEAR
+                                     : Texture::TRILINEAR;
+        }
+        else if (arg == "--stats" && hasValue)
+            settings.statsFile = argv[++idx];
+        else if (arg == "--progressive")
+            settings.progressive = true;
+        else if (arg == "--snapshot-interval" && hasValue)
+        {
+            settings.snapshotInterval = stod(argv[++idx]);
+            if (!(settings.snapshotInterval >= 0))
+                throw invalid_argument(arg + " needs a number of seconds");
+        }
+        else if (arg == "--png-level" && hasValue)
+        {
+            settings.pngLevel = stoul(argv[++idx]);
+            if (settings.pngLevel > PngEncoder::MAX_LEVEL)
+                throw invalid_argument(arg + " needs a level from 0 to 9");
+        }
+        else if (arg == "--simd" && hasValue)
+        {
+            SimdLevel level;
+            if (!parseSimdLevel(argv[++idx], level))
+                throw invalid_argument(arg + " needs scalar, sse2 or avx2");
+            if (setSimdLevel(level) != level)
+                cerr << "Warning: " << simdLevelName(level) << " is not "
+                        "supported, using " << simdLevelName(simdLevel())
+                     << ".\n";
+        }
+        else if (arg[0] != '-' && numFiles < 2)
+            files[numFiles++] = arg;
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (numFiles == 0)
+    {
+        usage(argv[0]);
         return 1;
     }
 
     Raytracer raytracer;
+    raytracer.setRenderSettings(settings);
 
     // Read the scene
-    if (!raytracer.readScene(argv[1]))
+    if (!raytracer.readScene(files[0]))
     {
-        cerr << "Error: reading scene from " << argv[1] <<
+        cerr << "Error: reading scene from " << files[0] <<
             " failed - no output generated.\n";
         return 1;
     }
 
     // Determine output name
     string ofname;
-    if (argc >= 3)
+    if (numFiles == 2)
     {
-        ofname = argv[2];   // use the provided name
+        ofname = files[1];  // use the provided name
     }
     else
     {
-        ofname = argv[1];   // replace .json with .png
+        ofname = files[0];  // replace .json with .png
         ofname.erase(ofname.begin() + ofname.find_last_of('.'), ofname.end());
         ofname += ".png";
     }
@@ -42,3 +173,8 @@ int main(int argc, char *argv[])
 
     return 0;
 }
+catch (exception const &ex)
+{
+    cerr << "Error: " << ex.what() << '\n';
+    return 1;
+}
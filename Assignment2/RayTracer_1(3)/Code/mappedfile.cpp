@@ -0,0 +1,70 @@
+#include "mappedfile.h"
+
+#include <fstream>
+#include <iterator>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAPPEDFILE_MMAP
+#endif
+
+using namespace std;
+
+MappedFile::MappedFile(string const &filename)
+:
+    d_data(nullptr),
+    d_size(0),
+    d_mapped(false),
+    d_open(false)
+{
+#ifdef MAPPEDFILE_MMAP
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+
+    struct stat info;
+    if (fstat(fd, &info) == 0)
+    {
+        d_open = true;
+        d_size = info.st_size;
+        if (d_size == 0)            // mmap refuses empty files
+            d_data = d_buffer.data();
+        else
+        {
+            void *addr = mmap(nullptr, d_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED)
+            {
+                d_data = static_cast<char const *>(addr);
+                d_mapped = true;
+                madvise(addr, d_size, MADV_SEQUENTIAL);
+            }
+        }
+    }
+    close(fd);
+
+    if (!d_open || d_mapped || d_size == 0)
+        return;
+#endif
+
+    // Not mappable (or no mmap): read the whole file instead
+    ifstream file(filename, ios::binary);
+    if (!file)
+        return;
+
+    d_buffer.assign(istreambuf_iterator<char>(file),
+                    istreambuf_iterator<char>());
+    d_data = d_buffer.data();
+    d_size = d_buffer.size();
+    d_open = true;
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef MAPPEDFILE_MMAP
+    if (d_mapped)
+        munmap(const_cast<char *>(d_data), d_size);
+#endif
+}
@@ -0,0 +1,58 @@
+#ifndef MAPPEDFILE_H_
+#define MAPPEDFILE_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Read-only view of a whole file. The file is memory mapped where the
+// platform supports it, so large models are parsed straight from the page
+// cache without being copied; elsewhere it is read into a buffer.
+class MappedFile
+{
+    char const *d_data;
+    size_t d_size;
+    bool d_mapped;                  // d_data must be unmapped
+    bool d_open;
+    std::vector<char> d_buffer;     // contents if not mapped
+
+    public:
+        explicit MappedFile(std::string const &filename);
+        ~MappedFile();
+
+        MappedFile(MappedFile const &) = delete;
+        MappedFile &operator=(MappedFile const &) = delete;
+
+        bool is_open() const;
+        char const *data() const;
+        size_t size() const;
+        char const *begin() const;
+        char const *end() const;
+};
+
+inline bool MappedFile::is_open() const
+{
+    return d_open;
+}
+
+inline char const *MappedFile::data() const
+{
+    return d_data;
+}
+
+inline size_t MappedFile::size() const
+{
+    return d_size;
+}
+
+inline char const *MappedFile::begin() const
+{
+    return d_data;
+}
+
+inline char const *MappedFile::end() const
+{
+    return d_data + d_size;
+}
+
+#endif
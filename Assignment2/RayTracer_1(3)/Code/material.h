@@ -3,6 +3,10 @@
 
 #include "triple.h"
 
+#include <memory>
+
+class Texture;
+
 class Material
 {
     public:
@@ -12,6 +16,17 @@ class Material
         double ks;          // specular intensity
         double n;           // exponent for specular highlight size
 
+        // mirrored and refracted fractions of the light, traced with
+        // secondary rays (see Scene::setRecursion)
+        double reflectivity = 0.0;
+        double transparency = 0.0;
+        double ior = 1.0;   // index of refraction
+
+        // multiplies color where it is mapped onto the object, if set,
+        // repeated textureRepeat times along both texture coordinates
+        std::shared_ptr<Texture const> texture;
+        double textureRepeat = 1.0;
+
         Material() = default;
 
         Material(Color const &color, double ka, double kd, double ks, double n)
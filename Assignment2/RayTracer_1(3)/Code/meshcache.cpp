@@ -0,0 +1,190 @@
+#include "meshcache.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace
+{
+    char const MAGIC[8] = { 'R', 'T', 'M', 'E', 'S', 'H', 0, 0 };
+    uint32_t const ENDIAN_TAG = 0x01020304;
+
+    uint64_t align16(uint64_t offset)
+    {
+        return (offset + 15) & ~uint64_t(15);
+    }
+
+    // FNV-1a, only computed when the time stamp of the OBJ changed
+    bool hashFile(string const &filename, uint64_t &hash)
+    {
+        MappedFile file(filename);
+        if (!file.is_open())
+            return false;
+
+        hash = 14695981039346656037ULL;
+        for (char const ch : file)
+            hash = (hash ^ static_cast<unsigned char>(ch)) * 1099511628211ULL;
+        return true;
+    }
+
+    // Stores time as the source time stamp of the cache file, so the OBJ is
+    // not hashed again by the next load. Failing is harmless.
+    void updateSourceTime(string const &cacheFile, int64_t time)
+    {
+        fstream file(cacheFile, ios::in | ios::out | ios::binary);
+        file.seekp(offsetof(MeshCache::Header, sourceTime));
+        file.write(reinterpret_cast<char const *>(&time), sizeof(time));
+    }
+
+    bool sourceInfo(string const &objFile, uint64_t &size, int64_t &time)
+    {
+        error_code error;
+        size = fs::file_size(objFile, error);
+        if (error)
+            return false;
+        time = fs::last_write_time(objFile, error).time_since_epoch().count();
+        return !error;
+    }
+}
+
+MeshCache::MeshCache(string const &objFile)
+:
+    d_file(filename(objFile)),
+    d_header(nullptr)
+{
+    if (!d_file.is_open() || d_file.size() < sizeof(Header))
+        return;
+
+    Header const *header = reinterpret_cast<Header const *>(d_file.data());
+    if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0
+        || header->version != VERSION || header->byteOrder != ENDIAN_TAG)
+        return;
+
+    // Is it a cache of the current OBJ file? A different time stamp alone
+    // (e.g. after a fresh checkout) is not enough to reject it.
+    uint64_t size;
+    int64_t time;
+    if (!sourceInfo(objFile, size, time) || size != header->sourceSize)
+        return;
+    uint64_t hash;
+    if (time != header->sourceTime
+        && (!hashFile(objFile, hash) || hash != header->sourceHash))
+        return;
+
+    // Guard against truncated or damaged files
+    uint64_t const numVertices = header->numVertices;
+    uint64_t const numIndices = header->numIndices;
+    struct { uint64_t offset; uint64_t bytes; } const arrays[] =
+    {
+        { header->positions, 3 * sizeof(float) * numVertices },
+        { header->normals, 3 * sizeof(float) * numVertices },
+        { header->texCoords, header->hasTexCoords
+                             ? 2 * sizeof(float) * numVertices : 0 },
+        { header->indices, sizeof(uint32_t) * numIndices }
+    };
+    for (auto const &array : arrays)
+        if (array.offset % 16 != 0 || array.offset > d_file.size()
+            || array.bytes > d_file.size() - array.offset)
+            return;
+
+    if (numIndices % 3 != 0)
+        return;
+    uint32_t const *indices = array<uint32_t>(header->indices);
+    for (uint64_t idx = 0; idx != numIndices; ++idx)
+        if (indices[idx] >= numVertices)
+            return;
+
+    d_header = header;
+
+    // The OBJ was only touched (its hash matched)
+    if (time != header->sourceTime)
+        updateSourceTime(filename(objFile), time);
+}
+
+string MeshCache::filename(string const &objFile)
+{
+    return objFile + ".rtmesh";
+}
+
+bool MeshCache::write(string const &objFile, vector<Vertex> const &vertices,
+                      vector<unsigned> const &indices, bool hasTexCoords)
+{
+    Header header {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.byteOrder = ENDIAN_TAG;
+    if (!sourceInfo(objFile, header.sourceSize, header.sourceTime)
+        || !hashFile(objFile, header.sourceHash))
+        return false;
+
+    header.numVertices = vertices.size();
+    header.numIndices = indices.size();
+    header.hasTexCoords = hasTexCoords;
+
+    // Lay out the arrays, each one 16 byte aligned
+    size_t const numVertices = vertices.size();
+    header.positions = align16(sizeof(Header));
+    header.normals = align16(header.positions
+                             + 3 * sizeof(float) * numVertices);
+    header.texCoords = align16(header.normals
+                               + 3 * sizeof(float) * numVertices);
+    header.indices = align16(header.texCoords
+                             + (hasTexCoords ? 2 * sizeof(float) : 0)
+                               * numVertices);
+    size_t const fileSize = header.indices + sizeof(uint32_t) * indices.size();
+
+    vector<char> buffer(fileSize);
+    memcpy(buffer.data(), &header, sizeof(Header));
+    float *positions = reinterpret_cast<float *>(&buffer[header.positions]);
+    float *normals = reinterpret_cast<float *>(&buffer[header.normals]);
+    float *texCoords = reinterpret_cast<float *>(&buffer[header.texCoords]);
+    for (Vertex const &vertex : vertices)
+    {
+        *positions++ = vertex.x;
+        *positions++ = vertex.y;
+        *positions++ = vertex.z;
+        *normals++ = vertex.nx;
+        *normals++ = vertex.ny;
+        *normals++ = vertex.nz;
+        if (hasTexCoords)
+        {
+            *texCoords++ = vertex.u;
+            *texCoords++ = vertex.v;
+        }
+    }
+    for (size_t idx = 0; idx != indices.size(); ++idx)
+    {
+        uint32_t const index = indices[idx];
+        memcpy(&buffer[header.indices + idx * sizeof(uint32_t)], &index,
+               sizeof(uint32_t));
+    }
+
+    // Write under a unique temporary name, then move it in place
+    string const cacheFile = filename(objFile);
+    string const tmpFile = cacheFile + ".tmp"
+        + to_string(chrono::steady_clock::now().time_since_epoch().count());
+    {
+        ofstream out(tmpFile, ios::binary);
+        if (!out.write(buffer.data(), buffer.size()))
+        {
+            out.close();
+            error_code error;
+            fs::remove(tmpFile, error);
+            return false;
+        }
+    }
+
+    error_code error;
+    fs::rename(tmpFile, cacheFile, error);
+    if (!error)
+        return true;
+
+    fs::remove(tmpFile, error);
+    return false;
+}
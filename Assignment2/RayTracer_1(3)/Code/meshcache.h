@@ -0,0 +1,122 @@
+#ifndef MESHCACHE_H_
+#define MESHCACHE_H_
+
+#include "mappedfile.h"
+#include "vertex.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Binary copy of the indexed data of an OBJ model (see
+// OBJLoader::indexed_data), stored next to it as <model>.obj.rtmesh.
+//
+// The file starts with a versioned header that records the size, time stamp
+// and hash of the OBJ it was made from, followed by packed arrays of
+// positions, normals, texture coordinates and indices. The arrays are 16 byte
+// aligned and used directly from the memory mapped file.
+class MeshCache
+{
+    public:
+        static uint32_t const VERSION = 1;
+
+        struct Header
+        {
+            char magic[8];              // "RTMESH" + 2 zero bytes
+            uint32_t version;
+            uint32_t byteOrder;         // 0x01020304 in the writer's order
+            uint64_t sourceSize;        // of the OBJ file, in bytes
+            int64_t sourceTime;         // last write time of the OBJ file
+            uint64_t sourceHash;        // FNV-1a of the OBJ file
+            uint32_t numVertices;
+            uint32_t numIndices;        // three per triangle
+            uint32_t hasTexCoords;
+            uint32_t reserved;
+            uint64_t positions;         // offsets of the arrays in the file
+            uint64_t normals;
+            uint64_t texCoords;
+            uint64_t indices;
+        };
+
+    private:
+        MappedFile d_file;
+        Header const *d_header;         // nullptr if there is no valid cache
+
+    public:
+        // Opens the cache of objFile. It is only used (valid() is true) if
+        // it is intact and the OBJ file has not changed since it was written.
+        explicit MeshCache(std::string const &objFile);
+
+        bool valid() const;
+
+        unsigned numVertices() const;
+        unsigned numTriangles() const;
+        bool hasTexCoords() const;
+
+        float const *positions() const;     // x, y, z per vertex
+        float const *normals() const;       // x, y, z per vertex
+        float const *texCoords() const;     // u, v per vertex
+        uint32_t const *indices() const;    // three per triangle
+
+        static std::string filename(std::string const &objFile);
+
+        // Writes the cache of objFile, returns false on failure. The file is
+        // written under a temporary name and then renamed, so concurrent
+        // renders never see half a cache.
+        static bool write(std::string const &objFile,
+                          std::vector<Vertex> const &vertices,
+                          std::vector<unsigned> const &indices,
+                          bool hasTexCoords);
+
+    private:
+        template <typename Type>
+        Type const *array(uint64_t offset) const;
+};
+
+inline bool MeshCache::valid() const
+{
+    return d_header != nullptr;
+}
+
+inline unsigned MeshCache::numVertices() const
+{
+    return d_header->numVertices;
+}
+
+inline unsigned MeshCache::numTriangles() const
+{
+    return d_header->numIndices / 3;
+}
+
+inline bool MeshCache::hasTexCoords() const
+{
+    return d_header->hasTexCoords != 0;
+}
+
+inline float const *MeshCache::positions() const
+{
+    return array<float>(d_header->positions);
+}
+
+inline float const *MeshCache::normals() const
+{
+    return array<float>(d_header->normals);
+}
+
+inline float const *MeshCache::texCoords() const
+{
+    return array<float>(d_header->texCoords);
+}
+
+inline uint32_t const *MeshCache::indices() const
+{
+    return array<uint32_t>(d_header->indices);
+}
+
+template <typename Type>
+inline Type const *MeshCache::array(uint64_t offset) const
+{
+    return reinterpret_cast<Type const *>(d_file.data() + offset);
+}
+
+#endif
@@ -0,0 +1,239 @@
+#include "meshgeometry.h"
+
+#include "meshcache.h"
+#include "objloader.h"
+#include "simd.h"
+#include "stats.h"
+#include "vertex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <utility>
+
+using namespace std;
+
+MeshGeometry::MeshGeometry(string const &filename,
+                           MeshOptions const &options)
+{
+    // Read the positions and triangles from the binary cache when it is up
+    // to date, otherwise parse the OBJ file (and cache the result). The
+    // normals are only kept for smooth shading.
+    vector<Point> positions;
+    vector<Vector> normals;
+    vector<float> texCoords;
+    vector<unsigned> indices;
+    bool cached = false;
+    if (options.cache)
+    {
+        MeshCache cache(filename);
+        if (cache.valid())
+        {
+            float const *coords = cache.positions();
+            float const *norms = cache.normals();
+            positions.reserve(cache.numVertices());
+            for (unsigned idx = 0; idx != cache.numVertices(); ++idx)
+            {
+                positions.push_back(Point(coords[3 * idx],
+                                          coords[3 * idx + 1],
+                                          coords[3 * idx + 2]));
+                if (options.smooth)
+                    normals.push_back(Vector(norms[3 * idx],
+                                             norms[3 * idx + 1],
+                                             norms[3 * idx + 2]));
+            }
+            if (cache.hasTexCoords())
+                texCoords.assign(cache.texCoords(),
+                                 cache.texCoords() + 2 * cache.numVertices());
+            indices.assign(cache.indices(),
+                           cache.indices() + 3 * cache.numTriangles());
+            cached = true;
+        }
+    }
+
+    if (!cached)
+    {
+        OBJLoader model(filename);
+        vector<Vertex> vertices;
+        model.indexed_data(vertices, indices);
+
+        // nothing to cache if the file could not be read (OBJLoader has
+        // reported that)
+        if (options.cache && !vertices.empty()
+            && !MeshCache::write(filename, vertices, indices,
+                                 model.hasTexCoords()))
+            cerr << "Could not write mesh cache "
+                 << MeshCache::filename(filename) << ".\n";
+
+        positions.reserve(vertices.size());
+        for (Vertex const &vertex : vertices)
+        {
+            positions.push_back(Point(vertex.x, vertex.y, vertex.z));
+            if (options.smooth)
+                normals.push_back(Vector(vertex.nx, vertex.ny, vertex.nz));
+            if (model.hasTexCoords())
+            {
+                texCoords.push_back(vertex.u);
+                texCoords.push_back(vertex.v);
+            }
+        }
+    }
+
+    d_streams = VertexStreams(normals, texCoords, options.compactVertices);
+    d_tris = TriangleBuffer(move(positions), move(indices));
+
+    vector<BBox> triBounds;
+    triBounds.reserve(d_tris.size());
+    for (unsigned tri = 0; tri != d_tris.size(); ++tri)
+        triBounds.push_back(d_tris.bounds(tri));
+    d_bvh.build(triBounds);
+    d_tris.reorder(d_bvh.indices());
+
+    cout << "Loaded model: " << filename << (cached ? " (cached)" : "")
+         << " with " << d_tris.size() << " triangles (" <<
+        memoryUsage() / max<size_t>(d_tris.size(), 1) <<
+        " bytes per triangle).\n";
+    cout << "  BVH: " << d_bvh.buildStats() << ".\n";
+}
+
+Hit MeshGeometry::intersect(Ray const &ray, double tMax) const
+{
+    STATS_INC(MESH_TESTS);
+
+    // Only test the triangles in the BVH leaves the ray passes through.
+    // The triangles are stored in leaf order, so every leaf is one
+    // contiguous batch.
+    unsigned hitTri = 0;
+    double u = 0;
+    double v = 0;
+    bool isHit = false;
+    d_bvh.traverse(ray, tMax, [&](unsigned first, unsigned count, double &tMax)
+    {
+        STATS_ADD(MESH_TRIANGLE_TESTS, count);
+        if (d_tris.intersect(ray, first, count, tMax, hitTri, u, v))
+            isHit = true;
+    });
+
+    if (!isHit)
+        return Hit::NO_HIT();
+    return Hit(tMax, hitTri, u, v);
+}
+
+bool MeshGeometry::occluded(Ray const &ray, double tMax) const
+{
+    STATS_INC(MESH_TESTS);
+
+    // Stops at the first leaf with a triangle closer than tMax
+    return d_bvh.occluded(ray, tMax, [&](unsigned first, unsigned count)
+    {
+        STATS_ADD(MESH_TRIANGLE_TESTS, count);
+        double t = tMax;
+        unsigned hitTri;
+        double u;
+        double v;
+        return d_tris.intersect(ray, first, count, t, hitTri, u, v);
+    });
+}
+
+unsigned MeshGeometry::intersectPacket(RayPacket const &packet,
+                                       unsigned mask, double *tMax,
+                                       PacketHit &hits) const
+{
+    STATS_ADD(MESH_TESTS, __builtin_popcount(mask));
+
+    // One traversal for the whole packet, every triangle in the leaves is
+    // tested against all rays that reached the leaf at once.
+    TriangleArrays const tris = d_tris.arrays();
+    TrianglePacketKernel const intersectTriangle =
+        kernels().intersectTrianglePacket;
+    unsigned hitMask = 0;
+    d_bvh.traverse(packet, mask, tMax,
+                   [&](unsigned first, unsigned count, unsigned laneMask,
+                       double *tMax)
+    {
+        STATS_ADD(MESH_TRIANGLE_TESTS, count * __builtin_popcount(laneMask));
+        for (unsigned tri = first; tri != first + count; ++tri)
+        {
+            real const v0[3] = { tris.v0[0][tri], tris.v0[1][tri],
+                                 tris.v0[2][tri] };
+            real const e1[3] = { tris.e1[0][tri], tris.e1[1][tri],
+                                 tris.e1[2][tri] };
+            real const e2[3] = { tris.e2[0][tri], tris.e2[1][tri],
+                                 tris.e2[2][tri] };
+
+            real t[RayPacket::SIZE];
+            real u[RayPacket::SIZE];
+            real v[RayPacket::SIZE];
+            unsigned triMask = intersectTriangle(packet.O, packet.D, v0, e1,
+                                                 e2, laneMask, t, u, v);
+            for (unsigned lane = 0; lane != RayPacket::SIZE; ++lane)
+            {
+                if ((triMask >> lane & 1) && t[lane] < tMax[lane])
+                {
+                    tMax[lane] = t[lane];
+                    hits.primitive[lane] = tri;
+                    hits.u[lane] = u[lane];
+                    hits.v[lane] = v[lane];
+                    hitMask |= 1U << lane;
+                }
+            }
+        }
+    });
+
+    for (unsigned lane = 0; lane != RayPacket::SIZE; ++lane)
+        if (hitMask >> lane & 1)
+            hits.t[lane] = tMax[lane];
+    return hitMask;
+}
+
+BBox MeshGeometry::bounds() const
+{
+    return d_bvh.bounds();
+}
+
+BBox MeshGeometry::bounds(Transform const &toWorld) const
+{
+    BBox box;
+    for (Point const &position : d_tris.positions())
+        box.extend(toWorld.point(position));
+    return box;
+}
+
+size_t MeshGeometry::memoryUsage() const
+{
+    return d_tris.memoryUsage() + d_streams.memoryUsage();
+}
+
+MeshLibrary::MeshLibrary(MeshOptions const &options)
+:
+    d_options(options)
+{}
+
+shared_ptr<MeshGeometry const> MeshLibrary::load(string const &filename,
+                                                 bool smooth)
+{
+    ++d_uses;
+    auto const key = make_pair(filename, smooth);
+    auto found = d_models.find(key);
+    if (found != d_models.end())
+        return found->second;
+
+    MeshOptions options = d_options;
+    options.smooth = smooth;
+    shared_ptr<MeshGeometry const> model =
+        make_shared<MeshGeometry const>(filename, options);
+    d_models.emplace(key, model);
+    return model;
+}
+
+size_t MeshLibrary::size() const
+{
+    return d_models.size();
+}
+
+unsigned MeshLibrary::uses() const
+{
+    return d_uses;
+}
+
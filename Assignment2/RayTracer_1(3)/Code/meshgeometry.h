@@ -0,0 +1,94 @@
+#ifndef MESHGEOMETRY_H_
+#define MESHGEOMETRY_H_
+
+#include "bbox.h"
+#include "bvh.h"
+#include "hit.h"
+#include "packet.h"
+#include "ray.h"
+#include "transform.h"
+#include "trianglebuffer.h"
+#include "vertexstreams.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+
+// How a mesh is loaded and stored
+struct MeshOptions
+{
+    bool smooth = false;            // shade with the interpolated normals
+                                    // of the vertices
+    bool cache = true;              // see meshcache.h
+    bool compactVertices = false;   // see VertexStreams
+};
+
+// The triangles of a model with their BVH and vertex streams, in the
+// coordinates of the model file. Shared by all meshes (see shapes/mesh.h)
+// showing the model, which trace rays transformed into model space. Never
+// changed after loading, so it is safe to share between threads.
+class MeshGeometry
+{
+    TriangleBuffer d_tris;          // stored in the leaf order of d_bvh
+    VertexStreams d_streams;        // normals (if smooth), texture coords
+    BVH d_bvh;
+
+    public:
+        MeshGeometry(std::string const &filename,
+                     MeshOptions const &options = MeshOptions());
+
+        // The closest hit of the ray before tMax: the distance, triangle
+        // and barycentric coordinates, or Hit::NO_HIT().
+        Hit intersect(Ray const &ray, double tMax) const;
+
+        // whether any triangle blocks the ray before tMax
+        bool occluded(Ray const &ray, double tMax) const;
+
+        // Intersects the rays of the packet in mask, which must be
+        // coherent(), with one traversal. Lowers tMax[lane] to the distance
+        // of a closer hit and stores that hit in hits. Returns the mask of
+        // lanes that hit.
+        unsigned intersectPacket(RayPacket const &packet, unsigned mask,
+                                 double *tMax, PacketHit &hits) const;
+
+        BBox bounds() const;
+
+        // box around the vertices mapped by toWorld
+        BBox bounds(Transform const &toWorld) const;
+
+        size_t memoryUsage() const;         // in bytes
+
+        TriangleBuffer const &triangles() const;
+        VertexStreams const &streams() const;
+};
+
+// Loads every model once per set of options, however many meshes show it.
+class MeshLibrary
+{
+    MeshOptions d_options;          // smooth is chosen per load()
+    std::map<std::pair<std::string, bool>,
+             std::shared_ptr<MeshGeometry const>> d_models;
+    unsigned d_uses = 0;
+
+    public:
+        explicit MeshLibrary(MeshOptions const &options = MeshOptions());
+
+        std::shared_ptr<MeshGeometry const> load(std::string const &filename,
+                                                 bool smooth);
+
+        size_t size() const;                // number of models loaded
+        unsigned uses() const;              // number of calls of load()
+};
+
+inline TriangleBuffer const &MeshGeometry::triangles() const
+{
+    return d_tris;
+}
+
+inline VertexStreams const &MeshGeometry::streams() const
+{
+    return d_streams;
+}
+
+#endif
@@ -1,13 +1,16 @@
 #ifndef OBJECT_H_
 #define OBJECT_H_
 
+#include "bbox.h"
 #include "material.h"
+#include "packet.h"
 
 // not really needed here, but deriving classes may need them
 #include "hit.h"
 #include "ray.h"
 #include "triple.h"
 
+#include <limits>
 #include <memory>
 class Object;
 typedef std::shared_ptr<Object> ObjectPtr;
@@ -19,8 +22,66 @@ class Object
 
         virtual ~Object() = default;
 
-        virtual Hit intersect(Ray const &ray) = 0;  // must be implemented
-                                                    // in derived class
+        // The closest hit of the ray, or a distance that is not below
+        // infinity (NaN or inf) if there is none. Only the distance, the
+        // primitive and the barycentric coordinates are set; the normal is
+        // left to normal(). Must be implemented in the derived class, and
+        // must not change the object: rays are traced from several threads
+        // at once.
+        virtual Hit intersect(Ray const &ray) const = 0;
+
+        // The normal at a hit returned by intersect(ray), facing the ray.
+        // Only called for the closest hit of all objects.
+        virtual Vector normal(Ray const &ray, Hit const &hit) const = 0;
+
+        // The texture coordinates at a hit returned by intersect(ray). scale
+        // receives how fast they change along the surface, in texture
+        // lengths per unit of distance, to choose a mip level. Only called
+        // for the closest hit, if the material has a texture. Shapes without
+        // a mapping return (0, 0) and a scale of 0.
+        virtual TexCoord texCoord(Ray const &ray, Hit const &hit,
+                                  double &scale) const
+        {
+            scale = 0.0;
+            return TexCoord{ 0.0, 0.0 };
+        }
+
+        virtual BBox bounds() const = 0;            // box enclosing the
+                                                    // whole object
+
+        // Whether the object blocks the ray before distance tMax (shadow
+        // rays). Shapes that can stop at any hit override this.
+        virtual bool occluded(Ray const &ray, double tMax) const
+        {
+            return intersect(ray).t < tMax;
+        }
+
+        // Intersects the rays of the packet that are in mask. Returns the
+        // mask of the rays that hit, their hits are stored in hits. Per ray
+        // the result equals intersect(); shapes with a SIMD kernel override
+        // this, others intersect the rays one by one.
+        virtual unsigned intersectPacket(RayPacket const &packet,
+                                         unsigned mask,
+                                         PacketHit &hits) const
+        {
+            unsigned hitMask = 0;
+            for (unsigned lane = 0; lane != RayPacket::SIZE; ++lane)
+            {
+                if (!(mask >> lane & 1))
+                    continue;
+
+                Hit hit = intersect(packet.ray(lane));
+                if (hit.t < std::numeric_limits<double>::infinity())
+                {
+                    hits.t[lane] = hit.t;
+                    hits.primitive[lane] = hit.primitive;
+                    hits.u[lane] = hit.u;
+                    hits.v[lane] = hit.v;
+                    hitMask |= 1U << lane;
+                }
+            }
+            return hitMask;
+        }
 };
 
 #endif
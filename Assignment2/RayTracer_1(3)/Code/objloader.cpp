@@ -3,12 +3,62 @@
 // Pro C++ Tip: here you can specify other includes you may need
 // such as <iostream>
 
-#include <fstream>
+#include "mappedfile.h"
+
+#include <charconv>
+#include <cstring>
 #include <iostream>
-#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
 
 using namespace std;
 
+namespace
+{
+    // Only spaces and tabs separate tokens; the \r of files with
+    // Windows line endings is treated as trailing white space.
+    inline bool isSpace(char ch)
+    {
+        return ch == ' ' || ch == '\t' || ch == '\r';
+    }
+
+    inline char const *skipSpace(char const *cursor, char const *end)
+    {
+        while (cursor != end && isSpace(*cursor))
+            ++cursor;
+        return cursor;
+    }
+
+    char const *parseFloat(char const *cursor, char const *end, float &value)
+    {
+        cursor = skipSpace(cursor, end);
+        if (cursor != end && *cursor == '+')    // from_chars rejects '+'
+            ++cursor;
+
+        from_chars_result result = from_chars(cursor, end, value);
+        if (result.ec != errc())
+            throw runtime_error("expected a number");
+        return result.ptr;
+    }
+
+    // Reads a 1-based (or negative, relative) index into a list of count
+    // elements and stores it 0-based in index. The element must be in the
+    // list, i.e. defined earlier in the file.
+    char const *parseIndex(char const *cursor, char const *end, size_t count,
+                           size_t &index)
+    {
+        long value = 0;
+        from_chars_result result = from_chars(cursor, end, value);
+        if (result.ec != errc() || value == 0
+            || (value > 0 ? static_cast<size_t>(value) > count
+                          : value < -static_cast<long>(count)))
+            throw runtime_error("invalid index in face");
+
+        index = value > 0 ? value - 1 : count + value;
+        return result.ptr;
+    }
+}
+
 // ===================================================================
 // -- Constructors and destructor ------------------------------------
 // ===================================================================
@@ -31,38 +81,48 @@ OBJLoader::OBJLoader(string const &filename)
 vector<Vertex> OBJLoader::vertex_data() const
 {
     vector<Vertex> data;
+    data.reserve(d_vertices.size());
 
     // For all vertices in the model, interleave the data
     for (Vertex_idx const &vertex : d_vertices)
+        data.push_back(vertexAt(vertex));
+
+    return data;    // copy elision
+}
+
+void OBJLoader::indexed_data(vector<Vertex> &vertices,
+                             vector<unsigned> &indices) const
+{
+    // Two face corners are the same vertex when they refer to the same
+    // coordinate, normal and texture coordinate.
+    struct IdxHash
     {
-        // Add coordinate data
-        Vertex vert;
-
-        vec3 const coord = d_coordinates.at(vertex.d_coord);
-        vert.x = coord.x;
-        vert.y = coord.y;
-        vert.z = coord.z;
-
-        // Add normal data
-        vec3 const norm = d_normals.at(vertex.d_norm);
-        vert.nx = norm.x;
-        vert.ny = norm.y;
-        vert.nz = norm.z;
-
-        // Add texture data (if available)
-        if (d_hasTexCoords)
+        size_t operator()(Vertex_idx const &vertex) const
         {
-            vec2 const tex = d_texCoords.at(vertex.d_tex);
-            vert.u = tex.u;      // u coordinate
-            vert.v = tex.v;      // v coordinate
-        } else {
-            vert.u = 0;
-            vert.v = 0;
+            return vertex.d_coord * 73856093U ^ vertex.d_norm * 19349663U
+                   ^ vertex.d_tex * 83492791U;
         }
-        data.push_back(vert);
-    }
+    };
+    struct IdxEqual
+    {
+        bool operator()(Vertex_idx const &lhs, Vertex_idx const &rhs) const
+        {
+            return lhs.d_coord == rhs.d_coord && lhs.d_norm == rhs.d_norm
+                   && lhs.d_tex == rhs.d_tex;
+        }
+    };
+    unordered_map<Vertex_idx, unsigned, IdxHash, IdxEqual> seen;
 
-    return data;    // copy elision
+    vertices.clear();
+    indices.clear();
+    indices.reserve(d_vertices.size());
+    for (Vertex_idx const &vertex : d_vertices)
+    {
+        auto inserted = seen.emplace(vertex, vertices.size());
+        if (inserted.second)
+            vertices.push_back(vertexAt(vertex));
+        indices.push_back(inserted.first->second);
+    }
 }
 
 unsigned OBJLoader::numTriangles() const
@@ -102,102 +162,167 @@ void OBJLoader::unitize()
 
 // --- Private -------------------------------------------------------
 
-void OBJLoader::parseFile(string const &filename)
+Vertex OBJLoader::vertexAt(Vertex_idx const &vertex) const
 {
-    ifstream file(filename);
-    if (file)
+    // Add coordinate data
+    Vertex vert;
+
+    vec3 const coord = d_coordinates.at(vertex.d_coord);
+    vert.x = coord.x;
+    vert.y = coord.y;
+    vert.z = coord.z;
+
+    // Add normal data
+    vec3 const norm = d_normals.at(vertex.d_norm);
+    vert.nx = norm.x;
+    vert.ny = norm.y;
+    vert.nz = norm.z;
+
+    // Add texture data (if available)
+    if (d_hasTexCoords)
     {
-        string line;
-        while(getline(file, line))
-            parseLine(line);
-
+        vec2 const tex = d_texCoords.at(vertex.d_tex);
+        vert.u = tex.u;      // u coordinate
+        vert.v = tex.v;      // v coordinate
     } else {
-        cerr << "Could not open: " << filename << " for reading!\n";
+        vert.u = 0;
+        vert.v = 0;
     }
+    return vert;
 }
 
-void OBJLoader::parseLine(string const &line)
+void OBJLoader::parseFile(string const &filename)
 {
-    if (line[0] == '#')
-        return;                     // ignore comments
+    MappedFile file(filename);
+    if (!file.is_open())
+    {
+        cerr << "Could not open: " << filename << " for reading!\n";
+        return;
+    }
 
-    StringList tokens = split(line, ' ', false);
+    size_t lineNr = 1;
+    char const *cursor = file.begin();
+    char const *const end = file.end();
+    try
+    {
+        while (cursor != end)
+        {
+            char const *eol = static_cast<char const *>(
+                                memchr(cursor, '\n', end - cursor));
+            if (eol == nullptr)
+                eol = end;
 
-    if (tokens[0] == "v")
-        parseVertex(tokens);
-    else if (tokens[0] == "vn")
-        parseNormal(tokens);
-    else if (tokens[0] == "vt")
-        parseTexCoord(tokens);
-    else if (tokens[0] == "f")
-        parseFace(tokens);
+            parseLine(cursor, eol);
+
+            cursor = eol == end ? end : eol + 1;
+            ++lineNr;
+        }
+    }
+    catch (runtime_error const &ex)
+    {
+        throw runtime_error(filename + ":" + to_string(lineNr) + ": "
+                            + ex.what());
+    }
+}
+
+void OBJLoader::parseLine(char const *cursor, char const *end)
+{
+    cursor = skipSpace(cursor, end);
+    if (cursor == end || *cursor == '#')
+        return;                     // ignore empty lines and comments
+
+    char const *keyword = cursor;
+    while (cursor != end && !isSpace(*cursor))
+        ++cursor;
+
+    size_t const length = cursor - keyword;
+    if (length == 1 && keyword[0] == 'v')
+        parseVertex(cursor, end);
+    else if (length == 2 && keyword[0] == 'v' && keyword[1] == 'n')
+        parseNormal(cursor, end);
+    else if (length == 2 && keyword[0] == 'v' && keyword[1] == 't')
+        parseTexCoord(cursor, end);
+    else if (length == 1 && keyword[0] == 'f')
+        parseFace(cursor, end);
 
     // Other data is also ignored
 }
 
-void OBJLoader::parseVertex(StringList const &tokens)
+void OBJLoader::parseVertex(char const *cursor, char const *end)
 {
     float x, y, z;
-    x = stof(tokens.at(1));         // 0 is the "v" token
-    y = stof(tokens.at(2));
-    z = stof(tokens.at(3));
+    cursor = parseFloat(cursor, end, x);
+    cursor = parseFloat(cursor, end, y);
+    parseFloat(cursor, end, z);
     d_coordinates.push_back(vec3{x, y, z});
 }
 
-void OBJLoader::parseNormal(StringList const &tokens)
+void OBJLoader::parseNormal(char const *cursor, char const *end)
 {
     float x, y, z;
-    x = stof(tokens.at(1));         // 0 is the "vn" token
-    y = stof(tokens.at(2));
-    z = stof(tokens.at(3));
+    cursor = parseFloat(cursor, end, x);
+    cursor = parseFloat(cursor, end, y);
+    parseFloat(cursor, end, z);
     d_normals.push_back(vec3{x, y, z});
 }
 
-void OBJLoader::parseTexCoord(StringList const &tokens)
+void OBJLoader::parseTexCoord(char const *cursor, char const *end)
 {
     d_hasTexCoords = true;          // Texture data will be read
 
     float u, v;
-    u = stof(tokens.at(1));         // 0 is the "vt" token
-    v = stof(tokens.at(2));
+    cursor = parseFloat(cursor, end, u);
+    parseFloat(cursor, end, v);
     d_texCoords.push_back(vec2{u, v});
 }
 
-void OBJLoader::parseFace(StringList const &tokens)
+void OBJLoader::parseFace(char const *cursor, char const *end)
 {
-    // skip the first token ("f")
-    for (size_t idx = 1; idx < tokens.size(); ++idx)
+    // every corner has the format:
+    // <vertex idx + 1>/<texture idx +1>/<normal idx + 1>
+    // Wavefront .obj files start counting from 1 (yuck), negative
+    // indices count back from the last element read so far.
+    d_polygon.clear();
+    while ((cursor = skipSpace(cursor, end)) != end)
     {
-        // format is:
-        // <vertex idx + 1>/<texture idx +1>/<normal idx + 1>
-        // Wavefront .obj files start counting from 1 (yuck)
-
-        StringList elements = split(tokens.at(idx), '/');
         Vertex_idx vertex {}; // initialize to zeros on all fields
 
-        vertex.d_coord = stoul(elements.at(0)) - 1U;
+        cursor = parseIndex(cursor, end, d_coordinates.size(),
+                            vertex.d_coord);
+        if (cursor == end || *cursor != '/')
+            throw runtime_error("face corner without a normal index");
+        ++cursor;
 
-        if (d_hasTexCoords)
-            vertex.d_tex = stoul(elements.at(1)) - 1U;
+        if (!d_hasTexCoords)            // the index is ignored
+        {
+            while (cursor != end && *cursor != '/' && !isSpace(*cursor))
+                ++cursor;
+        }
+        else if (cursor != end && *cursor != '/')
+            cursor = parseIndex(cursor, end, d_texCoords.size(),
+                                vertex.d_tex);
         else
-            vertex.d_tex = 0U;       // ignored
+            throw runtime_error("face corner without a texture index");
 
-        vertex.d_norm = stoul(elements.at(2)) - 1U;
+        if (cursor == end || *cursor != '/')
+            throw runtime_error("face corner without a normal index");
+        cursor = parseIndex(cursor + 1, end, d_normals.size(),
+                            vertex.d_norm);
 
-        d_vertices.push_back(vertex);
+        if (cursor != end && !isSpace(*cursor))
+            throw runtime_error("malformed face corner");
+
+        d_polygon.push_back(vertex);
     }
-}
 
-OBJLoader::StringList OBJLoader::split(string const &line,
-                            char splitChar,
-                            bool keepEmpty)
-{
-    StringList tokens;
-    istringstream iss(line);
-    string token;
-    while (getline(iss, token, splitChar))
-        if (token.size() > 0 || (token.size() == 0 && keepEmpty))
-            tokens.push_back(token);
-
-    return tokens;
+    if (d_polygon.size() < 3)
+        throw runtime_error("face with less than three corners");
+
+    // Split polygons into a fan of triangles around the first corner
+    for (size_t idx = 2; idx != d_polygon.size(); ++idx)
+    {
+        d_vertices.push_back(d_polygon[0]);
+        d_vertices.push_back(d_polygon[idx - 1]);
+        d_vertices.push_back(d_polygon[idx]);
+    }
 }
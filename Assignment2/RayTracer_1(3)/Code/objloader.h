@@ -46,7 +46,7 @@ class OBJLoader
 
     std::vector<Vertex_idx> d_vertices;
 
-    typedef std::vector<std::string> StringList;
+    std::vector<Vertex_idx> d_polygon;  // corners of the face being parsed
 
     public:
 
@@ -65,6 +65,17 @@ class OBJLoader
          */
         std::vector<Vertex> vertex_data() const;
 
+        /**
+         * @brief indexed_data
+         * @param vertices receives every distinct vertex once
+         * @param indices receives three indices into vertices per triangle
+         *
+         * Same geometry as vertex_data(), but corners shared by
+         * several triangles are only stored once.
+         */
+        void indexed_data(std::vector<Vertex> &vertices,
+                          std::vector<unsigned> &indices) const;
+
         unsigned numTriangles() const;
 
         bool hasTexCoords() const;
@@ -79,16 +90,17 @@ class OBJLoader
 
     private:
 
+        Vertex vertexAt(Vertex_idx const &vertex) const;
+
+        // The file is parsed in place (memory mapped, see mappedfile.h):
+        // every parse function reads from the cursor up to the end of the
+        // current line and never copies a token into a std::string.
         void parseFile(std::string const &filename);
-        void parseLine(std::string const &line);
-        void parseVertex(StringList const &tokens);
-        void parseNormal(StringList const &tokens);
-        void parseTexCoord(StringList const &tokens);
-        void parseFace(StringList const &tokens);
-
-        StringList split(std::string const &str,
-                         char splitChar,
-                         bool keepEmpty = true);
+        void parseLine(char const *cursor, char const *end);
+        void parseVertex(char const *cursor, char const *end);
+        void parseNormal(char const *cursor, char const *end);
+        void parseTexCoord(char const *cursor, char const *end);
+        void parseFace(char const *cursor, char const *end);
 };
 
 #endif // OBJLOADER_H_
@@ -0,0 +1,71 @@
+#ifndef PACKET_H_
+#define PACKET_H_
+
+#include "kernels.h"
+#include "ray.h"
+#include "triple.h"
+
+// A few rays traced together, e.g. the primary rays of 2x2 neighbouring
+// pixels. Stored as structure-of-arrays so the packet kernels (kernels.h)
+// load one component of all rays at once. Rays are identified by their
+// lane; a mask has bit i set when lane i takes part.
+class RayPacket
+{
+    public:
+        static unsigned const SIZE = PACKET_SIZE;
+        static unsigned const ALL = (1U << SIZE) - 1;
+
+        real O[3][SIZE];        // origins, O[axis][lane]
+        real D[3][SIZE];        // directions, D[axis][lane]
+
+        RayPacket()
+        :
+            O(),
+            D()
+        {}
+
+        void set(unsigned lane, Ray const &ray)
+        {
+            for (unsigned axis = 0; axis != 3; ++axis)
+            {
+                O[axis][lane] = ray.O.data[axis];
+                D[axis][lane] = ray.D.data[axis];
+            }
+        }
+
+        Ray ray(unsigned lane) const
+        {
+            return Ray(Point(O[0][lane], O[1][lane], O[2][lane]),
+                       Vector(D[0][lane], D[1][lane], D[2][lane]));
+        }
+
+        // Whether the rays in mask point into the same octant. Only then
+        // one front to back order through a BVH suits all of them.
+        bool coherent(unsigned mask) const
+        {
+            for (unsigned axis = 0; axis != 3; ++axis)
+            {
+                unsigned negative = 0;
+                for (unsigned lane = 0; lane != SIZE; ++lane)
+                    if (D[axis][lane] < 0)
+                        negative |= 1U << lane;
+                negative &= mask;
+                if (negative != 0 && negative != mask)
+                    return false;
+            }
+            return true;
+        }
+};
+
+// Result of intersecting the rays of a RayPacket: per lane the distance of
+// the hit, the part of the object that was hit and the barycentric
+// coordinates there, as in Hit. Only lanes in the returned mask are valid.
+struct PacketHit
+{
+    real t[RayPacket::SIZE];
+    unsigned primitive[RayPacket::SIZE];
+    real u[RayPacket::SIZE];
+    real v[RayPacket::SIZE];
+};
+
+#endif
@@ -0,0 +1,485 @@
+#include "pngencoder.h"
+
+#include "lode/lodepng.h"
+#include "tilescheduler.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+    size_t const BPP = 3;               // bytes per pixel
+    size_t const BAND_BYTES = 1 << 17;  // image bytes per band, at least a row
+
+    enum Filter { NONE, SUB, UP, AVERAGE, PAETH, NUM_FILTERS };
+
+    unsigned char paeth(int a, int b, int c)
+    {
+        int p = a + b - c;
+        int pa = abs(p - a);
+        int pb = abs(p - b);
+        int pc = abs(p - c);
+        if (pa <= pb && pa <= pc)
+            return a;
+        return pb <= pc ? b : c;
+    }
+
+    // Writes the filter type and row filtered with it to out. prev is the
+    // row above (unfiltered), all zeros for the first row.
+    void filterRow(unsigned char *out, unsigned type,
+                   unsigned char const *row, unsigned char const *prev,
+                   size_t size)
+    {
+        *out++ = type;
+        switch (type)
+        {
+            case NONE:
+                copy_n(row, size, out);
+                break;
+            case SUB:
+                copy_n(row, BPP, out);
+                for (size_t idx = BPP; idx < size; ++idx)
+                    out[idx] = row[idx] - row[idx - BPP];
+                break;
+            case UP:
+                for (size_t idx = 0; idx != size; ++idx)
+                    out[idx] = row[idx] - prev[idx];
+                break;
+            case AVERAGE:
+                for (size_t idx = 0; idx != size; ++idx)
+                {
+                    unsigned left = idx < BPP ? 0 : row[idx - BPP];
+                    out[idx] = row[idx] - (left + prev[idx]) / 2;
+                }
+                break;
+            case PAETH:
+                for (size_t idx = 0; idx != size; ++idx)
+                {
+                    if (idx < BPP)
+                        out[idx] = row[idx] - prev[idx];
+                    else
+                        out[idx] = row[idx] - paeth(row[idx - BPP], prev[idx],
+                                                    prev[idx - BPP]);
+                }
+                break;
+        }
+    }
+
+    // Filters row with the filter that gives the smallest sum of the
+    // filtered bytes taken as signed values (the heuristic of libpng and
+    // lodepng). scratch holds 1 + size bytes.
+    void filterRowMinSum(unsigned char *out, unsigned char *scratch,
+                         unsigned char const *row, unsigned char const *prev,
+                         size_t size)
+    {
+        size_t bestSum = ~size_t(0);
+        for (unsigned type = NONE; type != NUM_FILTERS; ++type)
+        {
+            filterRow(scratch, type, row, prev, size);
+            size_t sum = 0;
+            for (size_t idx = 1; idx <= size; ++idx)
+                sum += abs(static_cast<signed char>(scratch[idx]));
+            if (sum < bestSum)
+            {
+                bestSum = sum;
+                copy_n(scratch, size + 1, out);
+            }
+        }
+    }
+
+    uint32_t adler32(unsigned char const *data, size_t size)
+    {
+        uint32_t const BASE = 65521;
+        uint32_t a = 1;
+        uint32_t b = 0;
+        while (size != 0)
+        {
+            // the largest count for which b cannot overflow
+            size_t count = min<size_t>(size, 5552);
+            size -= count;
+            while (count-- != 0)
+            {
+                a += *data++;
+                b += a;
+            }
+            a %= BASE;
+            b %= BASE;
+        }
+        return b << 16 | a;
+    }
+
+    // the Adler-32 of two blocks of data from their own checksums and the
+    // size of the second one (as adler32_combine of zlib)
+    uint32_t adler32Combine(uint32_t first, uint32_t second, size_t size)
+    {
+        uint32_t const BASE = 65521;
+        uint32_t rem = size % BASE;
+        uint32_t a = first & 0xffff;
+        uint32_t b = rem * a % BASE;
+        a += (second & 0xffff) + BASE - 1;
+        b += (first >> 16) + (second >> 16) + BASE - rem;
+        if (a >= BASE)
+            a -= BASE;
+        if (a >= BASE)
+            a -= BASE;
+        if (b >= 2 * BASE)
+            b -= 2 * BASE;
+        if (b >= BASE)
+            b -= BASE;
+        return b << 16 | a;
+    }
+
+    // --- Deflate ------------------------------------------------------------
+
+    // Writes bits to a byte vector, least significant bit first as deflate
+    // packs them.
+    class BitWriter
+    {
+        vector<unsigned char> &d_out;
+        uint64_t d_bits = 0;
+        unsigned d_count = 0;
+
+        public:
+            explicit BitWriter(vector<unsigned char> &out)
+            :
+                d_out(out)
+            {}
+
+            // count <= 32
+            void write(uint32_t bits, unsigned count)
+            {
+                d_bits |= uint64_t(bits) << d_count;
+                d_count += count;
+                while (d_count >= 8)
+                {
+                    d_out.push_back(d_bits & 0xff);
+                    d_bits >>= 8;
+                    d_count -= 8;
+                }
+            }
+
+            // pads with zero bits up to the next byte
+            void align()
+            {
+                if (d_count != 0)
+                    write(0, 8 - d_count);
+            }
+    };
+
+    // A code of the fixed Huffman codes, bit reversed to be written by
+    // BitWriter
+    struct Code
+    {
+        uint16_t bits;
+        uint16_t length;
+    };
+
+    Code reversed(unsigned code, unsigned length)
+    {
+        unsigned bits = 0;
+        for (unsigned bit = 0; bit != length; ++bit)
+            bits |= (code >> bit & 1) << (length - 1 - bit);
+        return Code{ static_cast<uint16_t>(bits),
+                     static_cast<uint16_t>(length) };
+    }
+
+    // first length and distance of every code, and their extra bits
+    unsigned const LENGTH_BASE[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    unsigned const LENGTH_EXTRA[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    unsigned const DISTANCE_BASE[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+        8193, 12289, 16385, 24577 };
+    unsigned const DISTANCE_EXTRA[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    unsigned const MIN_MATCH = 3;
+    unsigned const MAX_MATCH = 258;
+    unsigned const WINDOW = 32768;
+    unsigned const HASH_BITS = 15;
+    unsigned const END_OF_BLOCK = 256;
+
+    // The fixed Huffman codes of deflate (RFC 1951, 3.2.6)
+    struct FixedCodes
+    {
+        Code literal[288];
+        Code distance[30];
+        uint8_t lengthCode[MAX_MATCH + 1];  // index in LENGTH_BASE
+
+        FixedCodes()
+        {
+            for (unsigned sym = 0; sym != 288; ++sym)
+            {
+                if (sym < 144)
+                    literal[sym] = reversed(0x30 + sym, 8);
+                else if (sym < 256)
+                    literal[sym] = reversed(0x190 + sym - 144, 9);
+                else if (sym < 280)
+                    literal[sym] = reversed(sym - 256, 7);
+                else
+                    literal[sym] = reversed(0xc0 + sym - 280, 8);
+            }
+            for (unsigned sym = 0; sym != 30; ++sym)
+                distance[sym] = reversed(sym, 5);
+            for (unsigned length = MIN_MATCH; length <= MAX_MATCH; ++length)
+                lengthCode[length] = upper_bound(LENGTH_BASE,
+                                                 LENGTH_BASE + 29, length)
+                                     - LENGTH_BASE - 1;
+        }
+    };
+
+    FixedCodes const FIXED;
+
+    // Deflates data as a fixed Huffman block that is not the final block,
+    // followed by an empty stored block. The output ends on a byte boundary,
+    // so the deflated bands can be concatenated (like a sync flush of zlib).
+    // At every position the chainLength most recent positions with the same
+    // hash are searched for the longest match.
+    void deflateFixed(vector<unsigned char> &out, unsigned char const *data,
+                      size_t size, unsigned chainLength)
+    {
+        vector<int32_t> head(1 << HASH_BITS, -1);
+        vector<int32_t> prev(size);
+        auto hash = [&](size_t pos)
+        {
+            uint32_t key = data[pos] << 16 | data[pos + 1] << 8
+                           | data[pos + 2];
+            return key * 2654435761U >> (32 - HASH_BITS);
+        };
+        auto insert = [&](size_t pos)
+        {
+            uint32_t key = hash(pos);
+            prev[pos] = head[key];
+            head[key] = pos;
+        };
+
+        BitWriter bits(out);
+        bits.write(1 << 1, 3);              // not final, fixed codes
+
+        size_t pos = 0;
+        while (pos < size)
+        {
+            unsigned bestLength = 0;
+            unsigned bestDistance = 0;
+            if (pos + MIN_MATCH <= size)
+            {
+                unsigned maxLength = min<size_t>(MAX_MATCH, size - pos);
+                int32_t match = head[hash(pos)];
+                for (unsigned chain = chainLength;
+                     chain != 0 && match >= 0 && pos - match <= WINDOW;
+                     --chain, match = prev[match])
+                {
+                    unsigned length = 0;
+                    while (length != maxLength
+                           && data[match + length] == data[pos + length])
+                        ++length;
+                    if (length > bestLength)
+                    {
+                        bestLength = length;
+                        bestDistance = pos - match;
+                        if (length == maxLength)
+                            break;
+                    }
+                }
+                insert(pos);
+            }
+
+            if (bestLength < MIN_MATCH)
+            {
+                Code code = FIXED.literal[data[pos]];
+                bits.write(code.bits, code.length);
+                ++pos;
+                continue;
+            }
+
+            unsigned lsym = FIXED.lengthCode[bestLength];
+            Code code = FIXED.literal[257 + lsym];
+            bits.write(code.bits, code.length);
+            bits.write(bestLength - LENGTH_BASE[lsym], LENGTH_EXTRA[lsym]);
+
+            unsigned dsym = upper_bound(DISTANCE_BASE, DISTANCE_BASE + 30,
+                                        bestDistance) - DISTANCE_BASE - 1;
+            code = FIXED.distance[dsym];
+            bits.write(code.bits, code.length);
+            bits.write(bestDistance - DISTANCE_BASE[dsym],
+                       DISTANCE_EXTRA[dsym]);
+
+            // the positions inside the match can start later matches
+            size_t end = pos + bestLength;
+            for (++pos; pos != end; ++pos)
+                if (pos + MIN_MATCH <= size)
+                    insert(pos);
+        }
+
+        Code code = FIXED.literal[END_OF_BLOCK];
+        bits.write(code.bits, code.length);
+
+        bits.write(0, 3);                   // not final, stored
+        bits.align();
+        out.insert(out.end(), { 0x00, 0x00, 0xff, 0xff });
+    }
+
+    // Stores data in blocks that are not final
+    void deflateStored(vector<unsigned char> &out, unsigned char const *data,
+                       size_t size)
+    {
+        do
+        {
+            size_t count = min<size_t>(size, 65535);
+            out.insert(out.end(), { 0x00,
+                                    static_cast<unsigned char>(count),
+                                    static_cast<unsigned char>(count >> 8),
+                                    static_cast<unsigned char>(~count),
+                                    static_cast<unsigned char>(~count >> 8) });
+            out.insert(out.end(), data, data + count);
+            data += count;
+            size -= count;
+        }
+        while (size != 0);
+    }
+
+    // --- PNG ----------------------------------------------------------------
+
+    void appendBigEndian(vector<unsigned char> &out, uint32_t value)
+    {
+        out.insert(out.end(), { static_cast<unsigned char>(value >> 24),
+                                static_cast<unsigned char>(value >> 16),
+                                static_cast<unsigned char>(value >> 8),
+                                static_cast<unsigned char>(value) });
+    }
+
+    void appendChunk(vector<unsigned char> &png, char const *type,
+                     unsigned char const *data, size_t size)
+    {
+        appendBigEndian(png, size);
+        size_t start = png.size();
+        png.insert(png.end(), type, type + 4);
+        png.insert(png.end(), data, data + size);
+        appendBigEndian(png, lodepng_crc32(&png[start], size + 4));
+    }
+}
+
+PngEncoder::PngEncoder(unsigned level, unsigned numThreads)
+:
+    d_level(level < MAX_LEVEL ? level : unsigned(MAX_LEVEL)),
+    d_numThreads(numThreads)
+{}
+
+vector<unsigned char> PngEncoder::encode(unsigned char const *rgb,
+                                         unsigned width,
+                                         unsigned height) const
+{
+    size_t const rowSize = BPP * width;
+    size_t const filteredRowSize = rowSize + 1;
+    unsigned const bandRows = max<size_t>(1, BAND_BYTES / (rowSize + 1));
+    unsigned const numBands = (height + bandRows - 1) / bandRows;
+    bool const fast = d_level >= 1 && d_level <= 3;
+
+    // one tile per band
+    TileScheduler scheduler(1, numBands, 1, d_numThreads);
+
+    vector<unsigned char> filtered(filteredRowSize * height);
+    vector<vector<unsigned char>> deflated(numBands);
+    vector<uint32_t> checksums(numBands);
+    vector<unsigned char> const zeros(rowSize);
+
+    scheduler.run([&](Tile const &tile, unsigned)
+    {
+        unsigned band = tile.y0;
+        unsigned y0 = band * bandRows;
+        unsigned y1 = min(y0 + bandRows, height);
+        unsigned char *out = &filtered[filteredRowSize * y0];
+        vector<unsigned char> scratch(filteredRowSize);
+        for (unsigned y = y0; y != y1; ++y)
+        {
+            unsigned char const *row = rgb + rowSize * y;
+            unsigned char const *prev = y == 0 ? zeros.data() : row - rowSize;
+            unsigned char *dest = &filtered[filteredRowSize * y];
+            if (d_level == 0)
+                filterRow(dest, NONE, row, prev, rowSize);
+            else if (d_level == 1)
+                filterRow(dest, PAETH, row, prev, rowSize);
+            else
+                filterRowMinSum(dest, scratch.data(), row, prev, rowSize);
+        }
+
+        size_t size = filteredRowSize * (y1 - y0);
+        if (d_level == 0)
+            deflateStored(deflated[band], out, size);
+        else if (fast)
+        {
+            unsigned const chainLength[] = { 0, 1, 8, 32 };
+            deflated[band].reserve(size / 2);
+            deflateFixed(deflated[band], out, size, chainLength[d_level]);
+        }
+        else
+            return;
+        checksums[band] = adler32(out, size);
+    });
+
+    vector<unsigned char> zlib;
+    if (d_level == 0 || fast)
+    {
+        size_t total = 0;
+        for (vector<unsigned char> const &band : deflated)
+            total += band.size();
+        zlib.reserve(total + 11);
+
+        // no preset dictionary, compression level not given
+        zlib.insert(zlib.end(), { 0x78, 0x01 });
+        uint32_t checksum = 1;
+        for (unsigned band = 0; band != numBands; ++band)
+        {
+            zlib.insert(zlib.end(), deflated[band].begin(),
+                        deflated[band].end());
+            unsigned y0 = band * bandRows;
+            unsigned y1 = min(y0 + bandRows, height);
+            checksum = adler32Combine(checksum, checksums[band],
+                                      filteredRowSize * (y1 - y0));
+        }
+        // an empty final stored block
+        zlib.insert(zlib.end(), { 0x01, 0x00, 0x00, 0xff, 0xff });
+        appendBigEndian(zlib, checksum);
+    }
+    else
+    {
+        LodePNGCompressSettings settings;
+        lodepng_compress_settings_init(&settings);
+        settings.windowsize = 512U << (d_level - 4);
+        if (d_level == MAX_LEVEL)
+            settings.nicematch = 258;
+
+        unsigned char *data = nullptr;
+        size_t size = 0;
+        unsigned error = lodepng_zlib_compress(&data, &size, filtered.data(),
+                                               filtered.size(), &settings);
+        if (!error)
+            zlib.assign(data, data + size);
+        free(data);
+        if (error)
+            throw runtime_error(string("PNG compression failed: ")
+                                + lodepng_error_text(error));
+    }
+
+    vector<unsigned char> png = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+    png.reserve(zlib.size() + 64);
+
+    vector<unsigned char> header;
+    appendBigEndian(header, width);
+    appendBigEndian(header, height);
+    // 8 bits RGB, deflate, adaptive filtering, no interlacing
+    header.insert(header.end(), { 8, 2, 0, 0, 0 });
+    appendChunk(png, "IHDR", header.data(), header.size());
+    appendChunk(png, "IDAT", zlib.data(), zlib.size());
+    appendChunk(png, "IEND", nullptr, 0);
+    return png;
+}
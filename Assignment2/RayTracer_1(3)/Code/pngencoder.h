@@ -0,0 +1,45 @@
+#ifndef PNGENCODER_H_
+#define PNGENCODER_H_
+
+#include <vector>
+
+// Encodes 8-bit RGB images as PNG, in bands of rows on a number of threads.
+//
+// The rows of every band are filtered on the thread of the band at every
+// level. How the filtered rows are compressed depends on the level:
+//  0     stored without filtering or compression, the fastest to write
+//  1-3   every band deflated on its own thread with the fixed Huffman codes,
+//        searching 1, 8 or 32 earlier positions for a match. Level 1 only
+//        uses the Paeth filter, the others pick a filter per row.
+//  4-9   the whole image deflated on one thread with dynamic Huffman codes
+//        (by lodepng), with a window of 512 to 16384 bytes. Level 6 gives
+//        the files lodepng writes by default.
+// Every level decodes to the same pixels.
+class PngEncoder
+{
+    unsigned d_level;
+    unsigned d_numThreads;
+
+    public:
+        static unsigned const MAX_LEVEL = 9;
+        static unsigned const DEFAULT_LEVEL = 6;
+
+        // level up to MAX_LEVEL, numThreads 0: all hardware threads
+        explicit PngEncoder(unsigned level = DEFAULT_LEVEL,
+                            unsigned numThreads = 0);
+
+        // the PNG file of the image in rgb: height rows of width pixels of
+        // three bytes
+        std::vector<unsigned char> encode(unsigned char const *rgb,
+                                          unsigned width,
+                                          unsigned height) const;
+
+        unsigned level() const;
+};
+
+inline unsigned PngEncoder::level() const
+{
+    return d_level;
+}
+
+#endif
@@ -3,6 +3,10 @@
 #include "image.h"
 #include "light.h"
 #include "material.h"
+#include "pngencoder.h"
+#include "simd.h"
+#include "stats.h"
+#include "tilescheduler.h"
 #include "triple.h"
 
 // =============================================================================
@@ -20,10 +24,13 @@
 // =============================================================================
 
 #include "json/json.h"
+#include "lode/lodepng.h"
 
+#include <chrono>
 #include <exception>
 #include <fstream>
 #include <iostream>
+#include <limits>
 
 using namespace std;        // no std:: required
 using json = nlohmann::json;
@@ -59,10 +66,34 @@ bool Raytracer::parseObjectNode(json const &node)
     else if(node["type"] == "mesh")
     {
         string filename = node["filename"];
-        Point position(node["position"]);
-        Vector rotation(node["rotation"]);
-        Vector scale(node["scale"]);
-        obj = ObjectPtr(new Mesh(filename, position, rotation, scale));
+        Transform toWorld;
+        if (node.count("transform"))
+        {
+            json const &rows = node["transform"];
+            double matrix[3][4];
+            if (rows.size() != 3)
+                throw runtime_error("Mesh transform must have 3 rows of 4 "
+                                    "numbers.");
+            for (unsigned row = 0; row != 3; ++row)
+            {
+                if (rows[row].size() != 4)
+                    throw runtime_error("Mesh transform must have 3 rows of "
+                                        "4 numbers.");
+                for (unsigned col = 0; col != 4; ++col)
+                    matrix[row][col] = rows[row][col];
+            }
+            toWorld = Transform(matrix);
+        }
+        else
+        {
+            Point position(node["position"]);
+            Vector rotation(node["rotation"]);
+            Vector scale(node["scale"]);
+            toWorld = Mesh::placement(position, rotation, scale);
+        }
+        obj = ObjectPtr(new Mesh(meshes.load(filename,
+                                             node.value("smooth", false)),
+                                 toWorld));
     }
     else if (node["type"] == "quad")
     {
@@ -90,26 +121,81 @@ bool Raytracer::parseObjectNode(json const &node)
     return true;
 }
 
+Camera Raytracer::parseCameraNode(json const &node) const
+{
+    Point eye(node["eye"]);
+    Point center(node["center"]);
+    Vector up(node["up"]);
+    unsigned width = node["viewSize"][0];
+    unsigned height = node["viewSize"][1];
+    if (width == 0 || height == 0 || up.length() == 0)
+        throw runtime_error("Camera needs a non-zero viewSize and up vector.");
+    // the image plane is spanned by up and the view direction
+    if ((center - eye).cross(up).length() == 0)
+        throw runtime_error("Camera up must not be parallel to the view "
+                            "direction, and eye and center must differ.");
+    return Camera(eye, center, up, width, height);
+}
+
 Light Raytracer::parseLightNode(json const &node) const
 {
     Point pos(node["position"]);
     Color col(node["color"]);
-    return Light(pos, col);
+
+    // constant, linear and quadratic
+    Triple atten(1, 0, 0);
+    if (node.count("attenuation"))
+    {
+        atten = Triple(node["attenuation"]);
+        if (atten.x < 0 || atten.y < 0 || atten.z < 0
+            || !(atten.x + atten.y + atten.z > 0))
+            throw runtime_error("Light attenuation must be non-negative and "
+                                "not all zero.");
+    }
+
+    double radius = node.value("radius",
+                               numeric_limits<double>::infinity());
+    if (!(radius > 0))
+        throw runtime_error("Light radius must be positive.");
+    return Light(pos, col, atten, radius);
 }
 
-Material Raytracer::parseMaterialNode(json const &node) const
+Material Raytracer::parseMaterialNode(json const &node)
 {
-    Color color(node["color"]);
+    // a textured material may leave out the color, the texture is used as is
+    bool textured = node.count("texture") != 0;
+    Color color = textured && !node.count("color") ? Color(1.0, 1.0, 1.0)
+                                                   : Color(node["color"]);
     double ka = node["ka"];
     double kd = node["kd"];
     double ks = node["ks"];
     double n  = node["n"];
-    return Material(color, ka, kd, ks, n);
+    Material material(color, ka, kd, ks, n);
+
+    material.reflectivity = node.value("reflectivity", 0.0);
+    material.transparency = node.value("transparency", 0.0);
+    material.ior = node.value("ior", 1.0);
+    if (material.reflectivity < 0 || material.transparency < 0
+        || material.reflectivity + material.transparency > 1)
+        throw runtime_error("Material reflectivity and transparency must be "
+                            "non-negative and add up to at most 1.");
+    if (!(material.ior > 0))
+        throw runtime_error("Material ior must be positive.");
+    if (textured)
+    {
+        material.texture = textures.load(node["texture"]);
+        material.textureRepeat = node.value("textureRepeat", 1.0);
+        if (!(material.textureRepeat > 0))
+            throw runtime_error("Material textureRepeat must be positive.");
+    }
+    return material;
 }
 
 bool Raytracer::readScene(string const &ifname)
 try
 {
+    auto const start = chrono::steady_clock::now();
+
     // Read and parse input json file
     ifstream infile(ifname);
     if (!infile) throw runtime_error("Could not open input file for reading.");
@@ -120,8 +206,42 @@ try
 // -- Read your scene data in this section -------------------------------------
 // =============================================================================
 
-    Point eye(jsonscene["Eye"]);
-    scene.setEye(eye);
+    // Either a full camera or only the eye, which looks at the image plane
+    // z = 0 of 400 x 400 pixels
+    if (jsonscene.count("Camera"))
+        scene.setCamera(parseCameraNode(jsonscene["Camera"]));
+    else
+    {
+        Point eye(jsonscene["Eye"]);
+        scene.setEye(eye);
+    }
+
+    if (jsonscene.count("SuperSamplingFactor"))
+    {
+        unsigned factor = jsonscene["SuperSamplingFactor"];
+        if (factor == 0)
+            throw runtime_error("SuperSamplingFactor must be at least 1.");
+        scene.setSuperSampling(factor, jsonscene.value("Jitter", true));
+    }
+
+    scene.setShadows(jsonscene.value("Shadows", false));
+    scene.setRecursion(jsonscene.value("MaxRecursionDepth", 5U),
+                       jsonscene.value("MinContribution", 1.0 / 256),
+                       jsonscene.value("RussianRouletteDepth", 0U));
+
+    double lightCutoff = jsonscene.value("LightCutoff", 0.0);
+    if (lightCutoff < 0)
+        throw runtime_error("LightCutoff must not be negative.");
+    scene.setLightCutoff(lightCutoff);
+
+    // every texture file is loaded once, however many materials use it
+    textures = TextureCache(settings.textureFormat);
+
+    // and every model once, however many meshes show it
+    MeshOptions meshOptions;
+    meshOptions.cache = settings.meshCache;
+    meshOptions.compactVertices = settings.compactVertices;
+    meshes = MeshLibrary(meshOptions);
 
     for (auto const &lightNode : jsonscene["Lights"])
         scene.addLight(parseLightNode(lightNode));
@@ -131,7 +251,20 @@ try
         if (parseObjectNode(objectNode))
             ++objCount;
 
-    cout << "Parsed " << objCount << " objects.\n";
+    cout << "Parsed " << objCount << " objects";
+    if (meshes.uses() != 0)
+        cout << ", " << meshes.uses()
+             << (meshes.uses() == 1 ? " mesh" : " meshes") << " of "
+             << meshes.size() << (meshes.size() == 1 ? " model" : " models");
+    cout << ".\n";
+
+    // Loading meshes (and building their BVHs) counts as parsing
+    auto const parsed = chrono::steady_clock::now();
+    scene.build();
+    timing.parseMs = chrono::duration<double, milli>(parsed - start).count();
+    timing.buildMs = chrono::duration<double, milli>(
+                        chrono::steady_clock::now() - parsed).count();
+    cout << "Scene BVH: " << scene.getBVH().buildStats() << ".\n";
 
 // =============================================================================
 // -- End of scene data reading ------------------------------------------------
@@ -147,11 +280,143 @@ catch (exception const &ex)
 
 void Raytracer::renderToFile(string const &ofname)
 {
-    // TODO: the size may be a settings in your file
-    Image img(400, 400);
-    cout << "Tracing...\n";
-    scene.render(img);
+    Camera const &camera = scene.getCamera();
+    Image img(camera.width, camera.height);
+    render(img, ofname);
+
     cout << "Writing image to " << ofname << "...\n";
-    img.write_png(ofname);
+    auto const start = chrono::steady_clock::now();
+    vector<unsigned char> png = img.encode_png(pngEncoder());
+    auto const encoded = chrono::steady_clock::now();
+    unsigned error = lodepng::save_file(png, ofname);
+    if (error)
+        throw runtime_error("Could not write " + ofname + ": "
+                            + lodepng_error_text(error));
+    timing.encodeMs = chrono::duration<double, milli>(encoded - start).count();
+    timing.writeMs = chrono::duration<double, milli>(
+                        chrono::steady_clock::now() - encoded).count();
+    cout << "Encoded " << png.size() << " bytes in " << timing.encodeMs
+         << " ms, written in " << timing.writeMs << " ms.\n";
+
+    if (!settings.statsFile.empty())
+    {
+        cout << "Writing statistics to " << settings.statsFile << "...\n";
+        writeStats(settings.statsFile);
+    }
     cout << "Done.\n";
 }
+
+void Raytracer::render(Image &img, string const &snapshotFile)
+{
+    unsigned numThreads = settings.numThreads == 0
+                        ? TileScheduler::defaultThreadCount()
+                        : settings.numThreads;
+    cout << "Tracing on " << numThreads << " thread(s) with "
+         << simdLevelName(simdLevel()) << " kernels...\n";
+    Stats::reset();
+
+    // In progressive mode the partial image is written to snapshotFile
+    // after a pass once snapshotInterval seconds have passed since the last
+    // write, so a long render can be checked (and aborted) early.
+    auto const start = chrono::steady_clock::now();
+    auto lastSnapshot = start;
+    auto passDone = [&](unsigned pass, unsigned numPasses)
+    {
+        if (!settings.progressive)
+            return;
+
+        auto const now = chrono::steady_clock::now();
+        cout << "Pass " << pass << '/' << numPasses << " done after "
+             << chrono::duration<double>(now - start).count() << " s";
+        if (pass != numPasses && !snapshotFile.empty()
+            && chrono::duration<double>(now - lastSnapshot).count()
+               >= settings.snapshotInterval)
+        {
+            // a failed snapshot does not stop the render
+            try
+            {
+                img.write_png(snapshotFile, pngEncoder());
+                cout << ", snapshot written";
+            }
+            catch (exception const &ex)
+            {
+                cout << ", snapshot failed (" << ex.what() << ')';
+            }
+            lastSnapshot = chrono::steady_clock::now();
+        }
+        cout << ".\n";
+    };
+    scene.render(img, settings, passDone);
+    timing.renderMs = chrono::duration<double, milli>(
+                        chrono::steady_clock::now() - start).count();
+    cout << "Traced in " << timing.renderMs << " ms.\n";
+    if (Stats::enabled())
+    {
+        vector<Stats::Block> threads = Stats::perThread();
+        double minBusy = threads.empty() ? 0.0 : threads[0].busyMs;
+        double maxBusy = minBusy;
+        for (Stats::Block const &thread : threads)
+        {
+            minBusy = min(minBusy, thread.busyMs);
+            maxBusy = max(maxBusy, thread.busyMs);
+        }
+        cout << "Statistics: " << Stats::total() << ".\n"
+             << "  Threads: " << threads.size() << " busy for " << minBusy
+             << " to " << maxBusy << " ms.\n";
+    }
+}
+
+void Raytracer::writeStats(string const &ofname) const
+{
+    auto counters = [](Stats::Block const &block)
+    {
+        json node;
+        for (unsigned idx = 0; idx != Stats::NUM_COUNTERS; ++idx)
+        {
+            Stats::Counter counter = static_cast<Stats::Counter>(idx);
+            node[Stats::name(counter)] = block[counter];
+        }
+        return node;
+    };
+
+    json stats;
+    stats["enabled"] = Stats::enabled();
+    stats["timing"] = { { "parseMs", timing.parseMs },
+                        { "buildMs", timing.buildMs },
+                        { "renderMs", timing.renderMs },
+                        { "encodeMs", timing.encodeMs },
+                        { "writeMs", timing.writeMs } };
+    stats["counters"] = counters(Stats::total());
+    stats["threads"] = json::array();
+    for (Stats::Block const &thread : Stats::perThread())
+    {
+        json node = { { "busyMs", thread.busyMs } };
+        node["counters"] = counters(thread);
+        stats["threads"].push_back(node);
+    }
+
+    ofstream out(ofname);
+    out << stats.dump(4) << '\n';
+    if (!out)
+        cerr << "Could not write statistics to " << ofname << ".\n";
+}
+
+PngEncoder Raytracer::pngEncoder() const
+{
+    return PngEncoder(settings.pngLevel, settings.numThreads);
+}
+
+Raytracer::Timing const &Raytracer::getTiming() const
+{
+    return timing;
+}
+
+Scene const &Raytracer::getScene() const
+{
+    return scene;
+}
+
+void Raytracer::setRenderSettings(RenderSettings const &renderSettings)
+{
+    settings = renderSettings;
+}
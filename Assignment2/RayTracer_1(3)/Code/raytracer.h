@@ -1,31 +1,72 @@
 #ifndef RAYTRACER_H_
 #define RAYTRACER_H_
 
+#include "meshgeometry.h"
+#include "rendersettings.h"
 #include "scene.h"
+#include "texture.h"
 
 #include <string>
 
 // Forward declarations
+class Camera;
+class Image;
 class Light;
 class Material;
 
 #include "json/json_fwd.h"
 
+class PngEncoder;
+
 class Raytracer
 {
-    Scene scene;
+    public:
+        // Wall clock time of the steps of the last readScene() and
+        // renderToFile() / render() calls
+        struct Timing
+        {
+            double parseMs = 0.0;       // reading the scene and its models
+            double buildMs = 0.0;       // building the scene BVH
+            double renderMs = 0.0;      // tracing the image
+            double encodeMs = 0.0;      // encoding the PNG image
+            double writeMs = 0.0;       // writing the PNG file
+        };
+
+    private:
+        Scene scene;
+        RenderSettings settings;
+        Timing timing;
+        TextureCache textures;          // of the scene being read
+        MeshLibrary meshes;             // of the scene being read
 
     public:
 
         bool readScene(std::string const &ifname);
         void renderToFile(std::string const &ofname);
 
+        // render the scene into img, which must have the size of the
+        // camera. Progressive snapshots are written to snapshotFile,
+        // none if it is empty.
+        void render(Image &img, std::string const &snapshotFile = "");
+
+        Timing const &getTiming() const;
+        Scene const &getScene() const;
+
+        void setRenderSettings(RenderSettings const &renderSettings);
+
     private:
 
         bool parseObjectNode(nlohmann::json const &node);
 
+        Camera parseCameraNode(nlohmann::json const &node) const;
         Light parseLightNode(nlohmann::json const &node) const;
-        Material parseMaterialNode(nlohmann::json const &node) const;
+        Material parseMaterialNode(nlohmann::json const &node);
+
+        // counters of the last render() (see stats.h) and the timing as JSON
+        void writeStats(std::string const &ofname) const;
+
+        // encoder of the output image and the snapshots
+        PngEncoder pngEncoder() const;
 };
 
 #endif
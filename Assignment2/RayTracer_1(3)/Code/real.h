@@ -0,0 +1,32 @@
+#ifndef REAL_H_
+#define REAL_H_
+
+// Floating point type of all geometry: points, vectors and colors (Triple),
+// bounding boxes, ray packets, triangle buffers and the intersection
+// kernels. Double by default. Configure with
+// cmake -DRAY_SINGLE_PRECISION=ON for float, which halves the memory used
+// by the geometry and doubles the number of lanes per SIMD instruction.
+// Distances along rays (Hit::t) and material parameters stay double.
+#ifdef RAY_SINGLE_PRECISION
+typedef float real;
+#else
+typedef double real;
+#endif
+
+// Smallest determinant and distance accepted by the ray - primitive tests.
+// Float distances are only accurate to about 1e-7 of the scene size.
+#ifdef RAY_SINGLE_PRECISION
+real const INTERSECT_EPSILON = 1e-5f;
+#else
+real const INTERSECT_EPSILON = 1e-7;
+#endif
+
+// Distance from the surface at which shadow, reflected and refracted rays
+// start, so they do not hit the surface they leave
+#ifdef RAY_SINGLE_PRECISION
+real const SURFACE_EPSILON = 1e-2f;
+#else
+real const SURFACE_EPSILON = 1e-4;
+#endif
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef RENDERSETTINGS_H_
+#define RENDERSETTINGS_H_
+
+#include "texture.h"
+
+#include <string>
+
+// Plain Old Data (POD) class holding the options that control how a scene
+// is rendered (as opposed to what is rendered).
+class RenderSettings
+{
+    public:
+        unsigned numThreads = 0;    // 0: use all hardware threads
+        unsigned tileSize = 16;     // width and height of a tile in pixels
+        bool packets = true;        // trace primary rays in 2x2 packets
+        bool threadBuffers = false; // render tiles into per-thread buffers
+        bool meshCache = true;      // load models from/to .rtmesh files
+        bool compactVertices = false;   // quantize vertex normals and
+                                        // texture coordinates of meshes
+        Texture::Format textureFormat = Texture::RGBA8;
+        Texture::Filter textureFilter = Texture::TRILINEAR;
+        bool progressive = false;   // render coarse to fine, see Scene
+        double snapshotInterval = 5.0;  // seconds between progressive
+                                        // snapshots of the output image
+        unsigned pngLevel = 6;      // compression, see PngEncoder
+        std::string statsFile;      // write statistics as JSON if not empty
+};
+
+#endif
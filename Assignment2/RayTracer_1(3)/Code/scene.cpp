@@ -4,32 +4,221 @@
 #include "image.h"
 #include "material.h"
 #include "ray.h"
+#include "stats.h"
+#include "texture.h"
+#include "tilescheduler.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <limits>
 
 using namespace std;
 
-Color Scene::trace(Ray const &ray)
+namespace
 {
-    // Find hit object and distance
-    Hit min_hit(numeric_limits<double>::infinity(), Vector());
-    ObjectPtr obj = nullptr;
-    for (unsigned idx = 0; idx != objects.size(); ++idx)
+    // Position in [0, 1) of a jittered sample along dimension dim (0 or 1).
+    // A hash of the pixel and sample (SplitMix64) instead of a random
+    // generator keeps the image independent of the order of the pixels.
+    double hashToUnit(uint64_t bits)
     {
-        Hit hit(objects[idx]->intersect(ray));
-        if (hit.t < min_hit.t)
+        bits ^= bits >> 30;
+        bits *= 0xBF58476D1CE4E5B9ULL;
+        bits ^= bits >> 27;
+        bits *= 0x94D049BB133111EBULL;
+        bits ^= bits >> 31;
+        return (bits >> 11) * (1.0 / 9007199254740992.0);   // 53 bits
+    }
+
+    double sampleJitter(unsigned x, unsigned y, unsigned sample, unsigned dim)
+    {
+        return hashToUnit((uint64_t(x) << 32 | y) * 0x9E3779B97F4A7C15ULL
+                          ^ (uint64_t(sample) << 1 | dim));
+    }
+
+    // Position in [0, 1) for the Russian roulette of a ray, a hash of the
+    // ray so that the image does not depend on the order of the pixels
+    double rouletteValue(Ray const &ray)
+    {
+        uint64_t bits = 0;
+        for (real const *value : { ray.O.data, ray.D.data })
         {
-            min_hit = hit;
-            obj = objects[idx];
+            for (unsigned axis = 0; axis != 3; ++axis)
+            {
+                uint64_t word = 0;
+                memcpy(&word, &value[axis], sizeof(real));
+                bits = (bits ^ word) * 0x9E3779B97F4A7C15ULL;
+            }
         }
+        return hashToUnit(bits);
     }
 
+    // Per thread and per light: the primitive that blocked the last shadow
+    // ray towards the light. Neighbouring pixels are mostly shadowed by the
+    // same object, so it is tested before the BVH is traversed. Stale
+    // entries (e.g. of a previous scene) only cost a test.
+    thread_local vector<unsigned> lastOccluder;
+}
+
+Color Scene::trace(Ray const &ray) const
+{
+    return trace(ray, 0, 1.0, false);
+}
+
+Color Scene::trace(Ray const &ray, unsigned depth, double weight,
+                   bool inside) const
+{
+    // Find hit object and distance. Only objects in the BVH leaves the ray
+    // passes through are tested; on equal distances the first added object
+    // wins, as in a linear search.
+    Hit min_hit(numeric_limits<double>::infinity());
+    CompiledScene::Primitive const *min_prim = nullptr;
+
+    double tMax = numeric_limits<double>::infinity();
+    bvh.traverse(ray, tMax, [&](unsigned first, unsigned count, double &tMax)
+    {
+        for (unsigned pos = first; pos != first + count; ++pos)
+        {
+            CompiledScene::Primitive const &prim = compiled.primitive(pos);
+            Hit hit(compiled.intersect(prim, ray));
+            if (hit.t < min_hit.t
+                || (hit.t == min_hit.t && prim.object < min_hit.object))
+            {
+                min_hit = hit;
+                min_hit.object = prim.object;
+                min_prim = &prim;
+                tMax = hit.t;
+            }
+        }
+    });
+
     // No hit? Return background color.
-    if (!obj)
+    if (min_prim == nullptr)
         return Color(0.0, 0.0, 0.0);
 
-    Material material = obj->material;          // the hit objects material
+    STATS_INC(HITS);
+    min_hit.N = compiled.normal(*min_prim, ray, min_hit);
+    Material const &material = compiled.material(min_hit.object);
+    return shade(ray, min_hit, material,
+                 surfaceColor(*min_prim, ray, min_hit, material), depth,
+                 weight, inside);
+}
+
+unsigned const Scene::NO_OCCLUDER;
+
+bool Scene::occluded(Ray const &ray, double tMax,
+                     unsigned &lastOccluder) const
+{
+    STATS_INC(SHADOW_RAYS);
+
+    unsigned const cached = lastOccluder;
+    if (cached < compiled.size()
+        && compiled.occluded(compiled.primitive(cached), ray, tMax))
+    {
+        STATS_INC(SHADOW_RAYS_BLOCKED);
+        STATS_INC(SHADOW_CACHE_HITS);
+        return true;
+    }
+
+    bool blocked = bvh.occluded(ray, tMax, [&](unsigned first, unsigned count)
+    {
+        for (unsigned pos = first; pos != first + count; ++pos)
+        {
+            if (pos != cached
+                && compiled.occluded(compiled.primitive(pos), ray, tMax))
+            {
+                lastOccluder = pos;
+                return true;
+            }
+        }
+        return false;
+    });
+
+    if (blocked)
+        STATS_INC(SHADOW_RAYS_BLOCKED);
+    return blocked;
+}
+
+void Scene::tracePacket(RayPacket const &packet, unsigned mask,
+                        Color *colors) const
+{
+    STATS_INC(PACKETS);
+
+    // Rays pointing into different octants cannot share a traversal
+    if (!packet.coherent(mask))
+    {
+        for (unsigned lane = 0; lane != RayPacket::SIZE; ++lane)
+            if (mask >> lane & 1)
+                colors[lane] = trace(packet.ray(lane));
+        return;
+    }
+
+    // As in trace(), per ray: the closest hit, the first added object on
+    // equal distances.
+    Hit const no_hit(numeric_limits<double>::infinity());
+    Hit min_hit[RayPacket::SIZE] = { no_hit, no_hit, no_hit, no_hit };
+    CompiledScene::Primitive const *min_prim[RayPacket::SIZE] = {};
+    double tMax[RayPacket::SIZE];
+    for (unsigned lane = 0; lane != RayPacket::SIZE; ++lane)
+        tMax[lane] = numeric_limits<double>::infinity();
+
+    bvh.traverse(packet, mask, tMax,
+                 [&](unsigned first, unsigned count, unsigned laneMask,
+                     double *tMax)
+    {
+        for (unsigned pos = first; pos != first + count; ++pos)
+        {
+            CompiledScene::Primitive const &prim = compiled.primitive(pos);
+            PacketHit hits;
+            unsigned hitMask = compiled.intersectPacket(prim, packet,
+                                                        laneMask, hits);
+            for (unsigned lane = 0; lane != RayPacket::SIZE; ++lane)
+            {
+                if (!(hitMask >> lane & 1))
+                    continue;
+
+                double t = hits.t[lane];
+                if (t < min_hit[lane].t
+                    || (t == min_hit[lane].t
+                        && prim.object < min_hit[lane].object))
+                {
+                    min_hit[lane] = Hit(t, hits.primitive[lane],
+                                        hits.u[lane], hits.v[lane]);
+                    min_hit[lane].object = prim.object;
+                    min_prim[lane] = &prim;
+                    tMax[lane] = t;
+                }
+            }
+        }
+    });
+
+    for (unsigned lane = 0; lane != RayPacket::SIZE; ++lane)
+    {
+        if (!(mask >> lane & 1))
+            continue;
+
+        if (min_prim[lane] != nullptr)
+        {
+            STATS_INC(HITS);
+            Ray const ray = packet.ray(lane);
+            min_hit[lane].N = compiled.normal(*min_prim[lane], ray,
+                                              min_hit[lane]);
+            Material const &material =
+                compiled.material(min_hit[lane].object);
+            colors[lane] = shade(ray, min_hit[lane], material,
+                                 surfaceColor(*min_prim[lane], ray,
+                                              min_hit[lane], material));
+        }
+        else
+            colors[lane] = Color(0.0, 0.0, 0.0);
+    }
+}
+
+Color Scene::shade(Ray const &ray, Hit const &min_hit, Material const &material,
+                   Color const &matColor, unsigned depth, double weight,
+                   bool inside) const
+{
     Point hit = ray.at(min_hit.t);              // the hit point
     Vector N = min_hit.N;                       // the normal at hit point
     Vector V = -ray.D;                          // the view vector
@@ -58,50 +247,378 @@ Color Scene::trace(Ray const &ray)
 
     /************** OUR CODE **************************/
     Color color;
-    int size = getNumLights();
-    Color Ai = material.color*material.ka;
-    for (int i = 0; i < size; i++) {
-        Vector l[size];
-        l[i] = (lights[i]->position - hit).normalized(); // create light vector
+    if (shadows && lastOccluder.size() < lights.size())
+        lastOccluder.resize(lights.size(), NO_OCCLUDER);
 
-        Color Di[size];
-        Di[i] = lights[i]->color*(max(0.0, N.dot(l[i]))*material.kd); 
+    lights.visit(hit, [&](size_t i)
+    {
+        STATS_INC(LIGHT_SAMPLES);
+        Vector toLight = lights.position(i) - hit;
+        double dist = toLight.length();
+        Vector L = toLight / dist;                  // the light vector
+        double NL = N.dot(L);
+
+        // A light behind the surface adds nothing, one in front of it only
+        // when nothing is in between
+        if (NL <= 0)
+            return;
+        if (shadows)
+        {
+            Ray shadowRay(hit + SURFACE_EPSILON * N, L);
+            if (occluded(shadowRay, dist, lastOccluder[i]))
+                return;
+        }
+
+        Color lightColor = lights.color(i) * lights.attenuation(i, dist);
+        Color Di = lightColor * (NL * material.kd);
+        Vector R = ((2.0 * NL) * N - L).normalized(); // reflection vector
+        Color Si = lightColor * (pow(max<double>(0.0, R.dot(V)), material.n)
+                                 * material.ks);
+        color += matColor * Di + Si;
+    });
+    color += matColor * material.ka;                // ambient
+
+    if (depth < maxDepth
+        && (material.reflectivity > 0 || material.transparency > 0))
+        color += shadeSecondary(ray, hit, N, material, depth, weight, inside);
+    return color;
+}
+
+Color Scene::surfaceColor(CompiledScene::Primitive const &prim,
+                          Ray const &ray, Hit const &hit,
+                          Material const &material) const
+{
+    if (!material.texture)
+        return material.color;
 
-        double NL = N.dot(l[i]);
-        Vector R[size];
-        R[i] = ((2.0*(NL)) * N - l[i]).normalized(); // create reflection vector
+    double scale;
+    TexCoord const coord = compiled.texCoord(prim, ray, hit, scale);
+    double const repeat = material.textureRepeat;
 
+    // The footprint of the ray: the distance between neighbouring samples
+    // at the hit, times the square root of the stretch where the ray grazes
+    // the surface, so the footprint has the area of the stretched one (up
+    // to 8 times the size). Secondary rays only count their own length.
+    double const cosine = max<double>(fabs(hit.N.dot(ray.D)), 1.0 / 64);
+    double const footprint = raySpread * hit.t / sqrt(cosine);
 
-        Color Si[size];
-        if (NL > 0) { // check wether the dot product of N and L is positive
-            Si[i] = lights[i]->color*(pow(max(0.0, R[i].dot(V)), material.n)*material.ks);
-        } else {
-            Si[i] = lights[i]->color*0.0;
+    Texture const &texture = *material.texture;
+    return material.color
+           * texture.sample(repeat * coord.s, repeat * coord.t,
+                            texture.lod(footprint * scale * repeat),
+                            textureFilter);
+}
+
+Color Scene::shadeSecondary(Ray const &ray, Point const &hit, Vector const &N,
+                            Material const &material, unsigned depth,
+                            double weight, bool inside) const
+{
+    // Hit normals face the ray, so whether the ray enters or leaves the
+    // object follows from the refractions along its path
+    double cosI = -N.dot(ray.D);
+    Vector facing = cosI > 0 ? N : -N;      // normal on the side of the ray
+    cosI = fabs(cosI);
+
+    double kr = material.reflectivity;
+    double kt = material.transparency;
+
+    // Snell's law, ray.D is a unit vector
+    Vector T;
+    if (kt > 0)
+    {
+        double eta = inside ? material.ior : 1.0 / material.ior;
+        double k = 1.0 - eta * eta * (1.0 - cosI * cosI);
+        if (k < 0)                          // total internal reflection
+        {
+            kr += kt;
+            kt = 0;
         }
-        color = color+ (material.color*Di[i] +  Si[i]);
+        else
+            T = eta * ray.D + (eta * cosI - sqrt(k)) * facing;
+    }
+
+    Color color(0.0, 0.0, 0.0);
+    if (kr > 0)
+    {
+        Vector R = ray.D + (2.0 * cosI) * facing;
+        Ray reflected(hit + SURFACE_EPSILON * facing, R);
+        color += kr * traceSecondary(reflected, depth, weight * kr, inside);
+    }
+    if (kt > 0)
+    {
+        Ray refracted(hit - SURFACE_EPSILON * facing, T.normalized());
+        color += kt * traceSecondary(refracted, depth, weight * kt,
+                                     !inside);
     }
-    color.operator+=(Ai);
     return color;
+}
 
+Color Scene::traceSecondary(Ray const &ray, unsigned depth, double weight,
+                            bool inside) const
+{
+    if (weight < minContribution)
+    {
+        STATS_INC(SECONDARY_RAYS_CUT);
+        return Color(0.0, 0.0, 0.0);
+    }
 
+    // Survivors of the roulette stand in for the dropped rays
+    double scale = 1.0;
+    if (rouletteDepth != 0 && depth + 1 >= rouletteDepth && weight < 1.0)
+    {
+        if (rouletteValue(ray) >= weight)
+        {
+            STATS_INC(SECONDARY_RAYS_CUT);
+            return Color(0.0, 0.0, 0.0);
+        }
+        scale = 1.0 / weight;
+    }
 
+    STATS_INC(SECONDARY_RAYS);
+    return scale * trace(ray, depth + 1, weight * scale, inside);
+}
+
+void Scene::build()
+{
+    vector<BBox> objBounds;
+    objBounds.reserve(objects.size());
+    for (ObjectPtr const &obj : objects)
+        objBounds.push_back(obj->bounds());
+    bvh.build(objBounds);
+    compiled.compile(objects, bvh.indices());
+    lights.build(lightCutoff);
+    built = true;
 }
 
-void Scene::render(Image &img)
+void Scene::render(Image &img, RenderSettings const &settings,
+                   PassCallback const &passDone)
 {
+    if (!built)
+        build();
+    textureFilter = settings.textureFilter;
+
     unsigned w = img.width();
     unsigned h = img.height();
-    for (unsigned y = 0; y < h; ++y)
+    TileScheduler scheduler(w, h, settings.tileSize, settings.numThreads);
+
+    auto primaryRay = [&](unsigned x, unsigned y)
+    {
+        return camera.ray(x + 0.5, y + 0.5);
+    };
+
+    // Stratified supersampling: pixel (x, y) is split into a grid of
+    // superSampling x superSampling cells with one sample in every cell,
+    // at a random (but fixed) position or at its center. The samples are
+    // clamped before they are averaged.
+    unsigned const numSamples = superSampling * superSampling;
+    auto sampleRay = [&](unsigned x, unsigned y, unsigned sample)
+    {
+        double u = jitter ? sampleJitter(x, y, sample, 0) : 0.5;
+        double v = jitter ? sampleJitter(x, y, sample, 1) : 0.5;
+        return camera.ray(x + (sample % superSampling + u) / superSampling,
+                          y + (sample / superSampling + v) / superSampling);
+    };
+
+    auto pixelColor = [&](unsigned x, unsigned y)
     {
-        for (unsigned x = 0; x < w; ++x)
+        STATS_ADD(PRIMARY_RAYS, numSamples);
+        if (numSamples == 1)
         {
-            Point pixel(x + 0.5, h - 1 - y + 0.5, 0);
-            Ray ray(eye, (pixel - eye).normalized());
-            Color col = trace(ray);
+            Color col = trace(primaryRay(x, y));
             col.clamp();
-            img(x, y) = col;
+            return col;
+        }
+
+        Color sum(0.0, 0.0, 0.0);
+        if (!settings.packets)
+        {
+            for (unsigned sample = 0; sample != numSamples; ++sample)
+            {
+                Color col = trace(sampleRay(x, y, sample));
+                col.clamp();
+                sum += col;
+            }
+            return sum / numSamples;
+        }
+
+        // The samples of one pixel are traced in packets, lane = sample
+        // modulo the packet size
+        for (unsigned first = 0; first < numSamples; first += RayPacket::SIZE)
+        {
+            RayPacket packet;
+            unsigned mask = 0;
+            for (unsigned lane = 0; lane != RayPacket::SIZE; ++lane)
+            {
+                if (first + lane < numSamples)
+                {
+                    packet.set(lane, sampleRay(x, y, first + lane));
+                    mask |= 1U << lane;
+                }
+            }
+
+            Color colors[RayPacket::SIZE];
+            tracePacket(packet, mask, colors);
+            for (unsigned lane = 0; lane != RayPacket::SIZE; ++lane)
+            {
+                if (mask >> lane & 1)
+                {
+                    colors[lane].clamp();
+                    sum += colors[lane];
+                }
+            }
         }
+        return sum / numSamples;
+    };
+
+    // Traces every pixel of the tile of out, in packets where possible
+    auto renderTile = [&](ImageView const &out)
+    {
+        Tile const &tile = out.tile();
+        if (!settings.packets || numSamples > 1)
+        {
+            for (unsigned y = tile.y0; y < tile.y1; ++y)
+                for (unsigned x = tile.x0; x < tile.x1; ++x)
+                    out(x, y) = pixelColor(x, y);
+            return;
+        }
+
+        // 2x2 pixels per packet, lane = 2 * row + column
+        for (unsigned y = tile.y0; y < tile.y1; y += 2)
+        {
+            for (unsigned x = tile.x0; x < tile.x1; x += 2)
+            {
+                RayPacket packet;
+                unsigned mask = 0;
+                for (unsigned lane = 0; lane != RayPacket::SIZE; ++lane)
+                {
+                    unsigned px = x + lane % 2;
+                    unsigned py = y + lane / 2;
+                    if (px < tile.x1 && py < tile.y1)
+                    {
+                        packet.set(lane, primaryRay(px, py));
+                        mask |= 1U << lane;
+                    }
+                }
+
+                STATS_ADD(PRIMARY_RAYS, __builtin_popcount(mask));
+                Color colors[RayPacket::SIZE];
+                tracePacket(packet, mask, colors);
+
+                for (unsigned lane = 0; lane != RayPacket::SIZE; ++lane)
+                {
+                    if (mask >> lane & 1)
+                    {
+                        colors[lane].clamp();
+                        out(x + lane % 2, y + lane / 2) = colors[lane];
+                    }
+                }
+            }
+        }
+    };
+
+    // Threads write the pixels of a tile to a view of img, or with
+    // settings.threadBuffers to a buffer of their own that is copied into
+    // img when the tile is done. With keep the buffer is first filled with
+    // the pixels in img, for renders that leave some of them as they are.
+    vector<TileBuffer> buffers(settings.threadBuffers
+                               ? scheduler.numThreads() : 0);
+    auto renderInto = [&](Tile const &tile, unsigned thread, bool keep,
+                          auto const &render)
+    {
+        if (buffers.empty())
+        {
+            render(img.view(tile));
+            return;
+        }
+
+        ImageView out = buffers[thread].view(tile);
+        if (keep)
+            out.copy(img.view(tile));
+        render(out);
+        img.view(tile).copy(out);
+    };
+
+    if (settings.progressive)
+    {
+        // Every pixel is traced once, in the pass that first reaches it,
+        // with the same ray as below. The final image does not depend on
+        // the mode.
+        vector<ProgressivePass> const passes = progressivePasses();
+        for (size_t idx = 0; idx != passes.size(); ++idx)
+        {
+            ProgressivePass const &pass = passes[idx];
+            scheduler.run([&](Tile const &tile, unsigned thread)
+            {
+                Stats::BusyTimer timer;
+                STATS_INC(TILES);
+                // a pass does not write every pixel of the tile
+                renderInto(tile, thread, true, [&](ImageView const &out)
+                {
+                    for (unsigned y = pass.first(tile.y0, pass.oy, pass.py);
+                         y < tile.y1; y += pass.py)
+                    {
+                        for (unsigned x = pass.first(tile.x0, pass.ox,
+                                                     pass.px);
+                             x < tile.x1; x += pass.px)
+                        {
+                            Color col = pixelColor(x, y);
+
+                            // Fill the block of pixels that are traced in
+                            // later passes, clipped to the tile
+                            unsigned x1 = min(x + pass.width, tile.x1);
+                            unsigned y1 = min(y + pass.height, tile.y1);
+                            for (unsigned by = y; by != y1; ++by)
+                                for (unsigned bx = x; bx != x1; ++bx)
+                                    out(bx, by) = col;
+                        }
+                    }
+                });
+            });
+            if (passDone)
+                passDone(idx + 1, passes.size());
+        }
+        return;
+    }
+
+    // Every pixel only depends on its own ray, so the tiles can be traced
+    // in any order and on any thread without changing the result.
+    scheduler.run([&](Tile const &tile, unsigned thread)
+    {
+        Stats::BusyTimer timer;
+        STATS_INC(TILES);
+        renderInto(tile, thread, false, renderTile);
+    });
+    if (passDone)
+        passDone(1, 1);
+}
+
+// --- Progressive rendering ---------------------------------------------------
+
+unsigned Scene::ProgressivePass::first(unsigned begin, unsigned offset,
+                                       unsigned period)
+{
+    // first value >= begin that equals offset modulo period
+    return begin + (offset + period - begin % period) % period;
+}
+
+vector<Scene::ProgressivePass> Scene::progressivePasses()
+{
+    // Like the interlacing of PNG (Adam7): start with one pixel out of every
+    // COARSE_STEP x COARSE_STEP block, then halve the block width and the
+    // block height in turns until every pixel has been traced.
+    vector<ProgressivePass> passes;
+    passes.push_back(ProgressivePass{ COARSE_STEP, 0, COARSE_STEP, 0,
+                                      COARSE_STEP, COARSE_STEP });
+    for (unsigned step = COARSE_STEP / 2; step != 0; step /= 2)
+    {
+        // the right halves of the 2step x 2step blocks
+        passes.push_back(ProgressivePass{ 2 * step, step, 2 * step, 0,
+                                          step, 2 * step });
+        // the bottom halves of all 2step high blocks
+        passes.push_back(ProgressivePass{ step, 0, 2 * step, step,
+                                          step, step });
     }
+    return passes;
 }
 
 // --- Misc functions ----------------------------------------------------------
@@ -109,16 +626,57 @@ void Scene::render(Image &img)
 void Scene::addObject(ObjectPtr obj)
 {
     objects.push_back(obj);
+    built = false;
 }
 
 void Scene::addLight(Light const &light)
 {
-    lights.push_back(LightPtr(new Light(light)));
+    lights.add(light);
+    built = false;
 }
 
 void Scene::setEye(Triple const &position)
 {
-    eye = position;
+    camera.eye = position;
+    updateRaySpread();
+}
+
+void Scene::setCamera(Camera const &newCamera)
+{
+    camera = newCamera;
+    updateRaySpread();
+}
+
+void Scene::setSuperSampling(unsigned factor, bool jitterSamples)
+{
+    superSampling = factor;
+    jitter = jitterSamples;
+    updateRaySpread();
+}
+
+void Scene::updateRaySpread()
+{
+    raySpread = camera.up.length() / (camera.center - camera.eye).length()
+                / superSampling;
+}
+
+void Scene::setShadows(bool enable)
+{
+    shadows = enable;
+}
+
+void Scene::setLightCutoff(double cutoff)
+{
+    lightCutoff = cutoff;
+    built = false;
+}
+
+void Scene::setRecursion(unsigned depth, double contribution,
+                         unsigned roulette)
+{
+    maxDepth = depth;
+    minContribution = contribution;
+    rouletteDepth = roulette;
 }
 
 unsigned Scene::getNumObject()
@@ -130,3 +688,23 @@ unsigned Scene::getNumLights()
 {
     return lights.size();
 }
+
+Camera const &Scene::getCamera() const
+{
+    return camera;
+}
+
+unsigned Scene::getSuperSampling() const
+{
+    return superSampling;
+}
+
+bool Scene::getShadows() const
+{
+    return shadows;
+}
+
+BVH const &Scene::getBVH() const
+{
+    return bvh;
+}
@@ -1,37 +1,169 @@
 #ifndef SCENE_H_
 #define SCENE_H_
 
-#include "light.h"
+#include "bvh.h"
+#include "camera.h"
+#include "compiledscene.h"
+#include "lightarray.h"
 #include "object.h"
+#include "rendersettings.h"
+#include "texture.h"
 #include "triple.h"
 
+#include <functional>
 #include <vector>
 
 // Forward declarations
-class Ray;
+class Hit;
 class Image;
+class Material;
+class Ray;
+class RayPacket;
 
 class Scene
 {
+    public:
+        // called after every pass of render() with the number of passes
+        // done and the total number of passes
+        typedef std::function<void(unsigned, unsigned)> PassCallback;
+
+    private:
     std::vector<ObjectPtr> objects;
-    std::vector<LightPtr> lights;   // no ptr needed, but kept for consistency
-    Point eye;
+    LightArray lights;              // packed, see lightarray.h
+    Camera camera;
+    unsigned superSampling = 1;     // superSampling^2 samples per pixel
+    bool jitter = true;             // jittered or centered samples
+    bool shadows = false;           // test the lights for occlusion
+    unsigned maxDepth = 5;          // bounces of secondary rays
+    double minContribution = 1.0 / 256;
+    unsigned rouletteDepth = 0;     // 0: no Russian roulette
+    double lightCutoff = 0;         // 0: every light reaches every point
+    double raySpread = 0.001;       // angle between neighbouring samples
+    Texture::Filter textureFilter = Texture::TRILINEAR;
+    BVH bvh;                        // over objects, see build()
+    CompiledScene compiled;         // objects in BVH leaf order
+    bool built = false;
 
     public:
 
-        // trace a ray into the scene and return the color
-        Color trace(Ray const &ray);
+        // trace a ray into the scene and return the color. Tracing does
+        // not change the scene, so once it is built (see build()) any
+        // number of threads can trace at the same time.
+        Color trace(Ray const &ray) const;
+
+        // Trace the rays of the packet that are in mask, colors[lane]
+        // receives the color of lane. The colors equal those of trace().
+        void tracePacket(RayPacket const &packet, unsigned mask,
+                         Color *colors) const;
+
+        // Any-hit query: whether an object blocks the ray before distance
+        // tMax. lastOccluder is the position in the compiled scene of a
+        // primitive that is tested first, typically the one that blocked a
+        // previous, similar ray, or NO_OCCLUDER. It is updated when another
+        // primitive blocks the ray.
+        bool occluded(Ray const &ray, double tMax,
+                      unsigned &lastOccluder) const;
 
-        // render the scene to the given image
-        void render(Image &img);
+        static unsigned const NO_OCCLUDER = ~0U;
+
+        // (re)build the BVH over the objects, the compiled scene that is
+        // traced and the index of the lights. Called by render() when
+        // objects or lights were added since the last build, must be called
+        // before trace() is used directly.
+        void build();
+
+        // render the scene to the given image (normally of the size of the
+        // camera), tile by tile on settings.numThreads threads. With
+        // settings.progressive the image is rendered coarse to fine in
+        // several passes, img holds a complete (blocky) preview after each
+        // of them.
+        void render(Image &img,
+                    RenderSettings const &settings = RenderSettings(),
+                    PassCallback const &passDone = PassCallback());
 
 
         void addObject(ObjectPtr obj);
         void addLight(Light const &light);
         void setEye(Triple const &position);
+        void setCamera(Camera const &newCamera);
+        void setSuperSampling(unsigned factor, bool jitterSamples = true);
+        void setShadows(bool enable);
+
+        // Reflected and refracted rays are traced up to maxDepth bounces
+        // deep. A ray is not traced when it would contribute less than
+        // minContribution to the pixel. From bounce rouletteDepth on
+        // (unless it is 0), rays are also dropped at random with a
+        // probability of one minus their contribution, and the ones that
+        // survive are weighted up to compensate (Russian roulette).
+        void setRecursion(unsigned maxDepth, double minContribution,
+                          unsigned rouletteDepth = 0);
+
+        // A light is skipped at points where its attenuated color is below
+        // cutoff in every channel, which bounds the error per light (see
+        // LightArray::build). 0 evaluates every light everywhere.
+        void setLightCutoff(double cutoff);
 
         unsigned getNumObject();
         unsigned getNumLights();
+
+        Camera const &getCamera() const;
+        unsigned getSuperSampling() const;
+        bool getShadows() const;
+        BVH const &getBVH() const;
+
+    private:
+        // width and height of the blocks of the first progressive pass
+        static unsigned const COARSE_STEP = 8;
+
+        // A progressive pass traces pixel (x, y) if x % px == ox and
+        // y % py == oy, and fills the width x height block at (x, y) with
+        // its color.
+        struct ProgressivePass
+        {
+            unsigned px;
+            unsigned ox;
+            unsigned py;
+            unsigned oy;
+            unsigned width;
+            unsigned height;
+
+            static unsigned first(unsigned begin, unsigned offset,
+                                  unsigned period);
+        };
+
+        static std::vector<ProgressivePass> progressivePasses();
+
+        // trace() of a ray depth bounces deep, that adds weight times its
+        // color to the pixel. inside: the ray travels through a transparent
+        // object (it was refracted into it).
+        Color trace(Ray const &ray, unsigned depth, double weight,
+                    bool inside) const;
+
+        // color of the hit of the ray with an object of the given material,
+        // whose color at the hit is matColor (see surfaceColor())
+        Color shade(Ray const &ray, Hit const &min_hit,
+                    Material const &material, Color const &matColor,
+                    unsigned depth = 0, double weight = 1.0,
+                    bool inside = false) const;
+
+        // The color of the material at the closest hit of the ray with
+        // prim: its color, times its texture filtered over the footprint
+        // of the ray if it has one
+        Color surfaceColor(CompiledScene::Primitive const &prim,
+                           Ray const &ray, Hit const &hit,
+                           Material const &material) const;
+
+        void updateRaySpread();
+
+        // light reflected and refracted at the hit
+        Color shadeSecondary(Ray const &ray, Point const &hit,
+                             Vector const &N, Material const &material,
+                             unsigned depth, double weight,
+                             bool inside) const;
+
+        // traces a reflected or refracted ray unless it is cut off
+        Color traceSecondary(Ray const &ray, unsigned depth, double weight,
+                             bool inside) const;
 };
 
 #endif
@@ -1,14 +1,32 @@
 #include "cylinder.h"
 
+#include "../stats.h"
+
 #include <cmath>
 
 using namespace std;
 
-Hit Cylinder::intersect(Ray const &ray)
+Hit Cylinder::intersect(Ray const &ray) const
 {
+    STATS_INC(CYLINDER_TESTS);
+
     return Hit::NO_HIT(); // placeholder
 }
 
+Vector Cylinder::normal(Ray const &ray, Hit const &hit) const
+{
+    return Vector(); // placeholder, intersect() never hits
+}
+
+BBox Cylinder::bounds() const
+{
+    // box around the spheres capping both ends of the axis
+    Vector R(radius, radius, radius);
+    BBox box(position - R, position + R);
+    box.extend(BBox(position + direction - R, position + direction + R));
+    return box;
+}
+
 Cylinder::Cylinder(Point const &pos, Vector const &direction, double radius)
 :
     position(pos),
@@ -3,7 +3,7 @@
 
 #include "../object.h"
 
-class Cylinder: public Object
+class Cylinder final: public Object
 {
     Point const position;
     Vector const direction;
@@ -12,7 +12,9 @@ class Cylinder: public Object
     public:
         Cylinder(Point const &pos, Vector const &direction, double radius);
 
-        virtual Hit intersect(Ray const &ray);
+        virtual Hit intersect(Ray const &ray) const;
+        virtual Vector normal(Ray const &ray, Hit const &hit) const;
+        virtual BBox bounds() const;
 };
 
 #endif
@@ -1,43 +1,132 @@
 #include "mesh.h"
 
-#include "../objloader.h"
-#include "../vertex.h"
-#include "triangle.h"
+#include "../stats.h"
 
 #include <cmath>
-#include <iostream>
 #include <limits>
+#include <utility>
 
 using namespace std;
 
-Hit Mesh::intersect(Ray const &ray)
+Mesh::Mesh(shared_ptr<MeshGeometry const> geometry, Transform const &toWorld)
+:
+    d_geometry(move(geometry)),
+    d_toWorld(toWorld),
+    d_toModel(toWorld.inverse()),
+    d_bounds(d_geometry->bounds(toWorld))
+{}
+
+Ray Mesh::toModel(Ray const &ray, double &scale) const
 {
-    ObjectPtr t;
-    bool isHit;
-    Hit minimal_Hit(numeric_limits<double>::infinity(), Triple());
-    Hit maximal_Hit(numeric_limits<double>::infinity(), Triple());
-    
-    // For-loop to iterate over the triagles from the mesh and 
-    //check if there is an intersection
-    for(size_t j = 0; j < d_tris.size(); j++) {
-        t = d_tris[j];
-        Hit hitIntersection = t->intersect(ray);
-
-        if(minimal_Hit.t > hitIntersection.t) {
-            isHit = true;
-            if(maximal_Hit.t > hitIntersection.t) {
-                maximal_Hit.t = hitIntersection.t;
-                maximal_Hit.N = hitIntersection.N;
-            }
-        }
-    }
+    // The direction is normalized so the intersection tests in model space
+    // see determinants of the same order as in a mesh of unit size,
+    // whatever the size of the mesh in the scene.
+    Vector D = d_toModel.vector(ray.D);
+    scale = D.length();
+    return Ray(d_toModel.point(ray.O), D / scale);
+}
+
+Vector Mesh::faceNormal(unsigned tri) const
+{
+    TriangleBuffer const &tris = d_geometry->triangles();
+    return d_toWorld.vector(tris.edge1(tri))
+           .cross(d_toWorld.vector(tris.edge2(tri)));
+}
 
-    // In case there is a hit return
-    if(isHit) {
-        return maximal_Hit;
-    } else {
-        return Hit::NO_HIT();
+Hit Mesh::intersect(Ray const &ray) const
+{
+    double scale;
+    Hit hit = d_geometry->intersect(toModel(ray, scale),
+                                    numeric_limits<double>::infinity());
+    hit.t /= scale;
+    return hit;
+}
+
+Vector Mesh::normal(Ray const &ray, Hit const &hit) const
+{
+    Vector N = faceNormal(hit.primitive).normalized();
+    if (N.dot(ray.D) > 0)
+        N = -N;
+    VertexStreams const &streams = d_geometry->streams();
+    if (!streams.hasNormals())
+        return N;
+
+    // The smooth normal on the side of the face the ray hits
+    Vector smooth = d_toModel.transposed(
+        streams.normal(d_geometry->triangles().corners(hit.primitive), hit.u,
+                       hit.v));
+    if (smooth.dot(N) < 0)
+        smooth = -smooth;
+    return smooth.dot(N) > 0 ? smooth.normalized() : N;
+}
+
+TexCoord Mesh::texCoord(Ray const &, Hit const &hit, double &scale) const
+{
+    scale = 0.0;
+    VertexStreams const &streams = d_geometry->streams();
+    if (!streams.hasTexCoords())
+        return TexCoord{ 0.0, 0.0 };
+
+    // the area of the triangle in the texture relative to its area in the
+    // scene
+    unsigned const *corners = d_geometry->triangles().corners(hit.primitive);
+    TexCoord const c0 = streams.texCoord(corners[0]);
+    TexCoord const c1 = streams.texCoord(corners[1]);
+    TexCoord const c2 = streams.texCoord(corners[2]);
+    double const texArea = fabs((c1.s - c0.s) * (c2.t - c0.t)
+                                - (c2.s - c0.s) * (c1.t - c0.t)) / 2;
+    double const area = faceNormal(hit.primitive).length() / 2;
+    if (area > 0)
+        scale = sqrt(texArea / area);
+
+    return streams.texCoord(corners, hit.u, hit.v);
+}
+
+bool Mesh::occluded(Ray const &ray, double tMax) const
+{
+    double scale;
+    Ray const local = toModel(ray, scale);
+    return d_geometry->occluded(local, tMax * scale);
+}
+
+unsigned Mesh::intersectPacket(RayPacket const &packet, unsigned mask,
+                               PacketHit &hits) const
+{
+    RayPacket local;
+    double scale[RayPacket::SIZE];
+    double tMax[RayPacket::SIZE];
+    for (unsigned lane = 0; lane != RayPacket::SIZE; ++lane)
+    {
+        tMax[lane] = numeric_limits<double>::infinity();
+        if (mask >> lane & 1)
+            local.set(lane, toModel(packet.ray(lane), scale[lane]));
     }
+
+    // One traversal for the whole packet if the rays still point into the
+    // same octant in model space
+    if (!local.coherent(mask))
+        return Object::intersectPacket(packet, mask, hits);
+
+    unsigned hitMask = d_geometry->intersectPacket(local, mask, tMax, hits);
+    for (unsigned lane = 0; lane != RayPacket::SIZE; ++lane)
+        if (hitMask >> lane & 1)
+            hits.t[lane] = tMax[lane] / scale[lane];
+    return hitMask;
+}
+
+BBox Mesh::bounds() const
+{
+    return d_bounds;
+}
+
+Transform Mesh::placement(Point const &position, Vector const &rotation,
+                          Vector const &scale)
+{
+    // the columns of the matrix are the transformed axes
+    return Transform(meshRot(Vector(scale.x, 0, 0), rotation),
+                     meshRot(Vector(0, scale.y, 0), rotation),
+                     meshRot(Vector(0, 0, scale.z), rotation),
+                     position);
 }
 
 Triple Mesh::meshRot(Triple toRotate, Triple rotation) {
@@ -66,44 +155,3 @@ Triple Mesh::meshRot(Triple toRotate, Triple rotation) {
 
     return tmpVector;
 }
-
-Mesh::Mesh(string const &filename, Point const &position, Vector const &rotation, Vector const &scale)
-{
-    OBJLoader model(filename);
-    d_tris.reserve(model.numTriangles());
-    vector<Vertex> vertices = model.vertex_data();
-    for (size_t tri = 0; tri != model.numTriangles(); ++tri)
-    {
-        Vertex one = vertices[tri * 3];
-        Point v0(one.x, one.y, one.z);
-
-        Vertex two = vertices[tri * 3 + 1];
-        Point v1(two.x, two.y, two.z);
-
-        Vertex three = vertices[tri * 3 + 2];
-        Point v2(three.x, three.y, three.z);
-
-        // Functionality for non-uniform scaling, rotation and translation to the three points
-        // of the triangle (v0, v1, and v2).
-
-        // Non-uniform scaling
-        v0 = v0 * scale;
-        v1 = v1 * scale;
-        v2 = v2 * scale;
-
-        // Rotation
-        v0 = meshRot(v0, rotation);
-        v1 = meshRot(v1, rotation);
-        v2 = meshRot(v2, rotation);
-
-        // Translation
-        v0 = v0 + position;
-        v1 = v1 + position;
-        v2 = v2 + position;
-
-        d_tris.push_back(ObjectPtr(new Triangle(v0, v1, v2)));
-    }
-
-    cout << "Loaded model: " << filename << " with " <<
-        model.numTriangles() << " triangles.\n";
-}
@@ -1,23 +1,63 @@
 #ifndef MESH_H_
 #define MESH_H_
 
+#include "../meshgeometry.h"
 #include "../object.h"
+#include "../transform.h"
 
-#include <string>
-#include <vector>
+#include <memory>
 
-class Mesh: public Object
+// An instance of a model: its shared MeshGeometry placed in the scene by a
+// transform, with a material of its own. Rays are mapped into model space
+// and traced through the BVH of the geometry, so the memory of a scene grows
+// with its number of distinct models, not with its number of meshes.
+class Mesh final: public Object
 {
-    std::vector<ObjectPtr> d_tris;
+    std::shared_ptr<MeshGeometry const> d_geometry;
+    Transform d_toWorld;
+    Transform d_toModel;
+    BBox d_bounds;                  // of the transformed vertices
 
     public:
-        Mesh(std::string const &filename,
-             Point const &position,
-             Vector const &rotation,
-             Vector const &scale);
+        // Throws runtime_error if toWorld cannot be inverted
+        Mesh(std::shared_ptr<MeshGeometry const> geometry,
+             Transform const &toWorld);
 
-        virtual Hit intersect(Ray const &ray);
-        Triple meshRot(Triple toRotate, Triple rotation);
+        virtual Hit intersect(Ray const &ray) const;
+        virtual Vector normal(Ray const &ray, Hit const &hit) const;
+
+        // the interpolated texture coordinates of the model, (0, 0) if it
+        // has none
+        virtual TexCoord texCoord(Ray const &ray, Hit const &hit,
+                                  double &scale) const;
+        virtual BBox bounds() const;
+        virtual bool occluded(Ray const &ray, double tMax) const;
+        virtual unsigned intersectPacket(RayPacket const &packet,
+                                         unsigned mask,
+                                         PacketHit &hits) const;
+
+        MeshGeometry const &geometry() const;
+
+        // The transform of a mesh in a scene file: scaled, rotated about
+        // the x, y and z axes (in that order) and moved to position
+        static Transform placement(Point const &position,
+                                   Vector const &rotation,
+                                   Vector const &scale);
+
+        static Triple meshRot(Triple toRotate, Triple rotation);
+
+    private:
+        // The ray in model space, with a unit direction. Distances along
+        // it are scale times those along ray.
+        Ray toModel(Ray const &ray, double &scale) const;
+
+        // normal of the triangle in the scene, its length is twice the area
+        Vector faceNormal(unsigned tri) const;
 };
 
+inline MeshGeometry const &Mesh::geometry() const
+{
+    return *d_geometry;
+}
+
 #endif
@@ -1,14 +1,19 @@
 #include "quad.h"
 
+#include "../stats.h"
+
+#include <cmath>
 #include <limits>
 
 using namespace std;
 
-Hit Quad::intersect(Ray const &ray)
+Hit QuadGeometry::intersect(Ray const &ray) const
 {
+    STATS_INC(QUAD_TESTS);
+
     Hit minimal_Hit(numeric_limits<double>::infinity(), Triple());
-    Hit intersectionT1 = T1->intersect(ray);
-    Hit intersectionT2 = T2->intersect(ray);
+    Hit intersectionT1 = T1.intersect(ray);
+    Hit intersectionT2 = T2.intersect(ray);
 
     // Check which of the quad triangles is closer to 
     //the ray and return it
@@ -16,17 +21,103 @@ Hit Quad::intersect(Ray const &ray)
         return intersectionT1;
     
     if(intersectionT2.t < minimal_Hit.t)
+    {
+        intersectionT2.primitive = 1;
         return intersectionT2;
+    }
 
     return Hit::NO_HIT();
 }
 
+unsigned QuadGeometry::intersectPacket(RayPacket const &packet,
+                                       unsigned mask, PacketHit &hits) const
+{
+    STATS_ADD(QUAD_TESTS, __builtin_popcount(mask));
+
+    // As above: T2 only counts for the rays that miss T1
+    unsigned hitMask = T1.intersectPacket(packet, mask, hits);
+    if (hitMask == mask)
+        return hitMask;
+
+    PacketHit hitsT2;
+    unsigned hitMaskT2 = T2.intersectPacket(packet, mask & ~hitMask, hitsT2);
+    for (unsigned lane = 0; lane != RayPacket::SIZE; ++lane)
+    {
+        if (hitMaskT2 >> lane & 1)
+        {
+            hits.t[lane] = hitsT2.t[lane];
+            hits.primitive[lane] = 1;
+            hits.u[lane] = hitsT2.u[lane];
+            hits.v[lane] = hitsT2.v[lane];
+        }
+    }
+    return hitMask | hitMaskT2;
+}
+
+TexCoord QuadGeometry::texCoord(Hit const &hit, double &scale) const
+{
+    scale = 1.0 / sqrt(T1.area() + T2.area());
+
+    // T1 is (v0, v2, v3), T2 is (v0, v1, v2)
+    if (hit.primitive == 0)
+        return TexCoord{ hit.u, hit.u + hit.v };
+    return TexCoord{ hit.u + hit.v, hit.v };
+}
+
+BBox QuadGeometry::bounds() const
+{
+    BBox box = T1.bounds();
+    box.extend(T2.bounds());
+    return box;
+}
+
+QuadGeometry::QuadGeometry(Point const &v0,
+                           Point const &v1,
+                           Point const &v2,
+                           Point const &v3)
+:
+    // The quad is split along the diagonal v0 - v2
+    T1(v0, v2, v3),
+    T2(v0, v1, v2)
+{}
+
+// --- Quad --------------------------------------------------------------------
+
+Hit Quad::intersect(Ray const &ray) const
+{
+    return d_geometry.intersect(ray);
+}
+
+Vector Quad::normal(Ray const &ray, Hit const &hit) const
+{
+    return d_geometry.normal(ray, hit);
+}
+
+TexCoord Quad::texCoord(Ray const &, Hit const &hit, double &scale) const
+{
+    return d_geometry.texCoord(hit, scale);
+}
+
+unsigned Quad::intersectPacket(RayPacket const &packet, unsigned mask,
+                               PacketHit &hits) const
+{
+    return d_geometry.intersectPacket(packet, mask, hits);
+}
+
+BBox Quad::bounds() const
+{
+    return d_geometry.bounds();
+}
+
+QuadGeometry const &Quad::geometry() const
+{
+    return d_geometry;
+}
+
 Quad::Quad(Point const &v0,
            Point const &v1,
            Point const &v2,
            Point const &v3)
-{
-    // Store and/or process the points defining the quad here.
-    T1 = new Triangle(v0, v2, v3);
-    T2 = new Triangle(v0, v1, v2);
-}
+:
+    d_geometry(v0, v1, v2, v3)
+{}
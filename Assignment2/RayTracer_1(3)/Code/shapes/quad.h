@@ -4,18 +4,55 @@
 #include "../object.h"
 #include "triangle.h"
 
-class Quad: public Object
+// Geometry and intersection code of a quad, split into two triangles.
+// Used by Quad and the compiled scene (see compiledscene.h).
+struct QuadGeometry
 {
+    TriangleGeometry T1;
+    TriangleGeometry T2;
+
+    QuadGeometry(Point const &v0, Point const &v1, Point const &v2,
+                 Point const &v3);
+
+    // the hit of T1 has primitive 0, that of T2 primitive 1
+    Hit intersect(Ray const &ray) const;
+    unsigned intersectPacket(RayPacket const &packet, unsigned mask,
+                             PacketHit &hits) const;
+    BBox bounds() const;
+
+    // the normal of the triangle that was hit, facing the ray
+    Vector normal(Ray const &ray, Hit const &hit) const;
+
+    // v0, v1, v2 and v3 have texture coordinates (0, 0), (1, 0), (1, 1)
+    // and (0, 1)
+    TexCoord texCoord(Hit const &hit, double &scale) const;
+};
+
+class Quad final: public Object
+{
+    QuadGeometry const d_geometry;
+
     public:
         Quad(Point const &v0,
              Point const &v1,
              Point const &v2,
              Point const &v3);
 
-        virtual Hit intersect(Ray const &ray);
+        virtual Hit intersect(Ray const &ray) const;
+        virtual Vector normal(Ray const &ray, Hit const &hit) const;
+        virtual TexCoord texCoord(Ray const &ray, Hit const &hit,
+                                  double &scale) const;
+        virtual BBox bounds() const;
+        virtual unsigned intersectPacket(RayPacket const &packet,
+                                         unsigned mask,
+                                         PacketHit &hits) const;
 
-    Triangle *T1;
-    Triangle *T2;
+        QuadGeometry const &geometry() const;
 };
 
+inline Vector QuadGeometry::normal(Ray const &ray, Hit const &hit) const
+{
+    return (hit.primitive == 0 ? T1 : T2).normal(ray);
+}
+
 #endif
@@ -1,11 +1,16 @@
 #include "sphere.h"
 
+#include "../simd.h"
+#include "../stats.h"
+
 #include <cmath>
 
 using namespace std;
 
-Hit Sphere::intersect(Ray const &ray)
+Hit SphereGeometry::intersect(Ray const &ray) const
 {
+    STATS_INC(SPHERE_TESTS);
+
     /****************************************************
     * RT1.1: INTERSECTION CALCULATION
     *
@@ -31,26 +36,21 @@ Hit Sphere::intersect(Ray const &ray)
 
 
     /**************** OUR CODE *************************/
-    Vector N;
-    // N.x = 0;
-    // N.y = 0;
-    // N.z = 0;
-
-    double A = (ray.D).dot(ray.D); // d*d
-    double B = (ray.D).dot(ray.O-position); // 2d * (e - c)
-    double C = (ray.O-position).dot(ray.O-position) - (r*r); // (e - c) * (e - c) - R*R
+    real A = (ray.D).dot(ray.D); // d*d
+    real B = (ray.D).dot(ray.O-position); // 2d * (e - c)
+    real C = (ray.O-position).dot(ray.O-position) - (r*r); // (e - c) * (e - c) - R*R
 
-    double D = sqrt((B*B) - (A*C));
-    double t;
+    real D = sqrt((B*B) - (A*C));
+    real t;
 
     if (D < 0) { // test how many intersections there are by checking discriminant
         return Hit::NO_HIT();
     } if (D == 0) { // there is only one point in which the ray intersect the sphere
         t = -B/A;
     } else { // there are two points and the smallest t is the one closest to the eye/camera
-        double t1 = (-B + D)/A; // compute both values for t with the quadratic formulas
-        double t2 = (-B - D)/A;
-        if (min(t1,t2) > 0) { // if both intersections are in front of the camera then use the closest one
+        real t1 = (-B + D)/A; // compute both values for t with the quadratic formulas
+        real t2 = (-B - D)/A;
+        if (min(t1,t2) > INTERSECT_EPSILON) { // if both intersections are in front of the camera then use the closest one
             t = min(t1,t2);
         } else { // if the camera is in the sphere then use the one in front of the camera 
             t = max(t1,t2);
@@ -66,21 +66,95 @@ Hit Sphere::intersect(Ray const &ray)
     * Insert calculation of the sphere's normal at the intersection point.
     ****************************************************/
 
-    N = ((ray.at(t))-position).normalized(); // normal vector is created by substracting
+    // behind (or too close to) the origin of the ray, like the triangle
+    // tests, or no intersection at all (NaN)
+    if (!(t > INTERSECT_EPSILON))
+        return Hit::NO_HIT();
+
+    return Hit(t);  // the normal follows from normalAt() for the closest hit
+}
+
+unsigned SphereGeometry::intersectPacket(RayPacket const &packet,
+                                         unsigned mask, PacketHit &hits) const
+{
+    STATS_ADD(SPHERE_TESTS, __builtin_popcount(mask));
+
+    unsigned hitMask = kernels().intersectSpherePacket(packet.O, packet.D,
+                                                       position.data, r,
+                                                       mask, hits.t);
+    for (unsigned lane = 0; lane != RayPacket::SIZE; ++lane)
+    {
+        hits.primitive[lane] = 0;
+        hits.u[lane] = 0;
+        hits.v[lane] = 0;
+    }
+    return hitMask;
+}
+
+Vector SphereGeometry::normalAt(Ray const &ray, double t) const
+{
+    Vector N = ((ray.at(t))-position).normalized(); // normal vector is created by substracting
                                             //  the centre of the sphere from the ray intersection point
     Vector V = -ray.D; // create the view vector
 
-    if (V.dot(N) >= 0) { // check wether the N vector is pointing in the right direction
-        return (t > 0 ? Hit(t, N) : Hit::NO_HIT());
-    } else {
-        N = -N; // flip N if the ray is coming from inside the sphere
-        return (t > 0 ? Hit(t, N) : Hit::NO_HIT());
-    }
-    
+    if (V.dot(N) >= 0) // check wether the N vector is pointing in the right direction
+        return N;
+    return -N; // flip N if the ray is coming from inside the sphere
+}
+
+TexCoord SphereGeometry::texCoordAt(Ray const &ray, double t,
+                                    double &scale) const
+{
+    Vector const P = (ray.at(t) - position) / r;
+
+    // a texture length is a circumference around, half of one upwards
+    scale = 1.0 / (M_PI * r * sqrt(2.0));
+    return TexCoord{ 0.5 + atan2(P.x, P.z) / (2 * M_PI),
+                     0.5 + asin(max<double>(-1.0, min<double>(1.0, P.y)))
+                           / M_PI };
+}
+
+BBox SphereGeometry::bounds() const
+{
+    Vector R(r, r, r);
+    return BBox(position - R, position + R);
+}
+
+// --- Sphere ------------------------------------------------------------------
+
+Hit Sphere::intersect(Ray const &ray) const
+{
+    return d_geometry.intersect(ray);
+}
+
+Vector Sphere::normal(Ray const &ray, Hit const &hit) const
+{
+    return d_geometry.normalAt(ray, hit.t);
+}
+
+TexCoord Sphere::texCoord(Ray const &ray, Hit const &hit,
+                          double &scale) const
+{
+    return d_geometry.texCoordAt(ray, hit.t, scale);
+}
+
+unsigned Sphere::intersectPacket(RayPacket const &packet, unsigned mask,
+                                 PacketHit &hits) const
+{
+    return d_geometry.intersectPacket(packet, mask, hits);
+}
+
+BBox Sphere::bounds() const
+{
+    return d_geometry.bounds();
+}
+
+SphereGeometry const &Sphere::geometry() const
+{
+    return d_geometry;
 }
 
 Sphere::Sphere(Point const &pos, double radius)
 :
-    position(pos),
-    r(radius)
+    d_geometry{ pos, real(radius) }
 {}
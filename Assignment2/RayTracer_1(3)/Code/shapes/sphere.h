@@ -3,15 +3,44 @@
 
 #include "../object.h"
 
-class Sphere: public Object
+// Geometry and intersection code of a sphere, without the Object interface
+// (material, virtual functions). Used by Sphere and, stored in a contiguous
+// array, by the compiled scene (see compiledscene.h).
+struct SphereGeometry
 {
+    Point position;
+    real r;
+
+    Hit intersect(Ray const &ray) const;
+    unsigned intersectPacket(RayPacket const &packet, unsigned mask,
+                             PacketHit &hits) const;
+    BBox bounds() const;
+
+    // normal at distance t along the ray, facing the ray
+    Vector normalAt(Ray const &ray, double t) const;
+
+    // Texture coordinates at distance t along the ray: s goes around the
+    // y axis, starting and ending at -z, t from the bottom to the top
+    TexCoord texCoordAt(Ray const &ray, double t, double &scale) const;
+};
+
+class Sphere final: public Object
+{
+    SphereGeometry const d_geometry;
+
     public:
         Sphere(Point const &pos, double radius);
 
-        virtual Hit intersect(Ray const &ray);
+        virtual Hit intersect(Ray const &ray) const;
+        virtual Vector normal(Ray const &ray, Hit const &hit) const;
+        virtual TexCoord texCoord(Ray const &ray, Hit const &hit,
+                                  double &scale) const;
+        virtual BBox bounds() const;
+        virtual unsigned intersectPacket(RayPacket const &packet,
+                                         unsigned mask,
+                                         PacketHit &hits) const;
 
-        Point const position;
-        double const r;
+        SphereGeometry const &geometry() const;
 };
 
 #endif
@@ -1,60 +1,101 @@
 #include "triangle.h"
+#include "../simd.h"
+#include "../stats.h"
 #include <tgmath.h>
 
 /* The source basic concepts and general algorithm:
  https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-rendering-a-triangle/ray-triangle-intersection-geometric-solution
  */
 
-Hit Triangle::intersect(Ray const &ray)
+Hit TriangleGeometry::intersect(Ray const &ray) const
 {
-    double Eps = 0.0000001;
+    STATS_INC(TRIANGLE_TESTS);
+
+    real const Eps = INTERSECT_EPSILON;    // see real.h
 
-    if(N.dot(ray.D) > 0) 
-        N = -N;
-   
     Triple v0v1Edge = v1 - v0;
     Triple v0v2Edge = v2 - v0;
 
     Triple vectorP = ray.D.cross(v0v2Edge);
-    double determinant = v0v1Edge.dot(vectorP);
+    real determinant = v0v1Edge.dot(vectorP);
 
     /* Check the case when the plane that contains the 
     triangle is parallel to the ray (ray direction) */
     if(fabs(determinant) < Eps)
         return Hit::NO_HIT();
     
-    double determinantInverse = 1.0 / determinant;
+    real determinantInverse = 1.0 / determinant;
     
     // Calculate the vector from ray origin to P (the hit point on the plane)
     Triple vectorT = ray.O - v0;
 
     // Normalizing u for cases when determinant is negative
-    double u = vectorT.dot(vectorP) * determinantInverse;
+    real u = vectorT.dot(vectorP) * determinantInverse;
 
     // Check for the case when triangle is behind the ray
     if(u < 0 || u > 1)
         return Hit::NO_HIT();
     
     Triple vectorQ = vectorT.cross(v0v1Edge);
-    double v = ray.D.dot(vectorQ) * determinantInverse;
+    real v = ray.D.dot(vectorQ) * determinantInverse;
 
     // Check if the ray intersects the triangle
     if(v + u > 1 || v < 0)
         return Hit::NO_HIT();
     
     // Calculate the distance as we know that the triangle is intersected
-    double t = v0v2Edge.dot(vectorQ) * determinantInverse;
+    real t = v0v2Edge.dot(vectorQ) * determinantInverse;
 
     if(t > Eps) {
-        return Hit(t, N);
+        return Hit(t, 0, u, v);
     } else {
         return Hit::NO_HIT();
     }
 }
 
-Triangle::Triangle(Point const &v0,
-                   Point const &v1,
-                   Point const &v2)
+unsigned TriangleGeometry::intersectPacket(RayPacket const &packet,
+                                           unsigned mask,
+                                           PacketHit &hits) const
+{
+    STATS_ADD(TRIANGLE_TESTS, __builtin_popcount(mask));
+
+    Triple v0v1Edge = v1 - v0;
+    Triple v0v2Edge = v2 - v0;
+
+    unsigned hitMask = kernels().intersectTrianglePacket(packet.O, packet.D,
+                                                         v0.data,
+                                                         v0v1Edge.data,
+                                                         v0v2Edge.data,
+                                                         mask, hits.t,
+                                                         hits.u, hits.v);
+    for (unsigned lane = 0; lane != RayPacket::SIZE; ++lane)
+        hits.primitive[lane] = 0;
+    return hitMask;
+}
+
+TexCoord TriangleGeometry::texCoord(Hit const &hit, double &scale) const
+{
+    // the texture triangle has area 1/2
+    scale = sqrt(0.5 / area());
+    return TexCoord{ hit.u, hit.v };
+}
+
+double TriangleGeometry::area() const
+{
+    return (v1 - v0).cross(v2 - v0).length() / 2;
+}
+
+BBox TriangleGeometry::bounds() const
+{
+    BBox box(v0, v0);
+    box.extend(v1);
+    box.extend(v2);
+    return box;
+}
+
+TriangleGeometry::TriangleGeometry(Point const &v0,
+                                   Point const &v1,
+                                   Point const &v2)
 :
     v0(v0),
     v1(v1),
@@ -66,3 +107,44 @@ Triangle::Triangle(Point const &v0,
     N = (v1 - v0).cross(v2 - v0); 
     N.normalize();
 }
+
+// --- Triangle ----------------------------------------------------------------
+
+Hit Triangle::intersect(Ray const &ray) const
+{
+    return d_geometry.intersect(ray);
+}
+
+Vector Triangle::normal(Ray const &ray, Hit const &) const
+{
+    return d_geometry.normal(ray);
+}
+
+TexCoord Triangle::texCoord(Ray const &, Hit const &hit,
+                            double &scale) const
+{
+    return d_geometry.texCoord(hit, scale);
+}
+
+unsigned Triangle::intersectPacket(RayPacket const &packet, unsigned mask,
+                                   PacketHit &hits) const
+{
+    return d_geometry.intersectPacket(packet, mask, hits);
+}
+
+BBox Triangle::bounds() const
+{
+    return d_geometry.bounds();
+}
+
+TriangleGeometry const &Triangle::geometry() const
+{
+    return d_geometry;
+}
+
+Triangle::Triangle(Point const &v0,
+                   Point const &v1,
+                   Point const &v2)
+:
+    d_geometry(v0, v1, v2)
+{}
@@ -3,19 +3,56 @@
 
 #include "../object.h"
 
-class Triangle: public Object
+// Geometry and intersection code of a triangle, without the Object
+// interface. Used by Triangle, Quad and the compiled scene (see
+// compiledscene.h).
+struct TriangleGeometry
 {
+    Point v0;
+    Point v1;
+    Point v2;
+    Vector N;       // unit normal, (v1 - v0) x (v2 - v0)
+
+    TriangleGeometry(Point const &v0, Point const &v1, Point const &v2);
+
+    Hit intersect(Ray const &ray) const;
+    unsigned intersectPacket(RayPacket const &packet, unsigned mask,
+                             PacketHit &hits) const;
+    BBox bounds() const;
+
+    // N or -N, facing the ray
+    Vector normal(Ray const &ray) const;
+
+    // v0, v1 and v2 have texture coordinates (0, 0), (1, 0) and (0, 1)
+    TexCoord texCoord(Hit const &hit, double &scale) const;
+
+    double area() const;
+};
+
+class Triangle final: public Object
+{
+    TriangleGeometry const d_geometry;
+
     public:
         Triangle(Point const &v0,
                  Point const &v1,
                  Point const &v2);
 
-        virtual Hit intersect(Ray const &ray);
+        virtual Hit intersect(Ray const &ray) const;
+        virtual Vector normal(Ray const &ray, Hit const &hit) const;
+        virtual TexCoord texCoord(Ray const &ray, Hit const &hit,
+                                  double &scale) const;
+        virtual BBox bounds() const;
+        virtual unsigned intersectPacket(RayPacket const &packet,
+                                         unsigned mask,
+                                         PacketHit &hits) const;
 
-        Point v0;
-        Point v1;
-        Point v2;
-        Vector N;
+        TriangleGeometry const &geometry() const;
 };
 
+inline Vector TriangleGeometry::normal(Ray const &ray) const
+{
+    return N.dot(ray.D) > 0 ? -N : N;
+}
+
 #endif
@@ -0,0 +1,96 @@
+#include "simd.h"
+
+#include "kernels.h"
+
+using namespace std;
+
+namespace
+{
+    Kernels const *kernelsOf(SimdLevel level)
+    {
+        switch (level)
+        {
+            case SimdLevel::AVX2:
+                return avx2Kernels();
+            case SimdLevel::SSE2:
+                return sse2Kernels();
+            default:
+                return scalarKernels();
+        }
+    }
+
+    bool cpuSupports(SimdLevel level)
+    {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+        switch (level)
+        {
+            case SimdLevel::AVX2:
+                return __builtin_cpu_supports("avx2");
+            case SimdLevel::SSE2:
+                return __builtin_cpu_supports("sse2");
+            default:
+                return true;
+        }
+#else
+        return level == SimdLevel::SCALAR;
+#endif
+    }
+
+    SimdLevel &currentLevel()
+    {
+        static SimdLevel level = detectSimdLevel();
+        return level;
+    }
+}
+
+SimdLevel detectSimdLevel()
+{
+    for (SimdLevel level : {SimdLevel::AVX2, SimdLevel::SSE2})
+        if (kernelsOf(level) && cpuSupports(level))
+            return level;
+    return SimdLevel::SCALAR;
+}
+
+SimdLevel setSimdLevel(SimdLevel requested)
+{
+    SimdLevel best = detectSimdLevel();
+    currentLevel() = requested > best ? best : requested;
+    return currentLevel();
+}
+
+SimdLevel simdLevel()
+{
+    return currentLevel();
+}
+
+Kernels const &kernels()
+{
+    return *kernelsOf(currentLevel());
+}
+
+char const *simdLevelName(SimdLevel level)
+{
+    switch (level)
+    {
+        case SimdLevel::AVX2:
+            return "avx2";
+        case SimdLevel::SSE2:
+            return "sse2";
+        default:
+            return "scalar";
+    }
+}
+
+bool parseSimdLevel(string const &name, SimdLevel &level)
+{
+    for (SimdLevel candidate : {SimdLevel::SCALAR, SimdLevel::SSE2,
+                                SimdLevel::AVX2})
+    {
+        if (name == simdLevelName(candidate))
+        {
+            level = candidate;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,31 @@
+#ifndef SIMD_H_
+#define SIMD_H_
+
+#include <string>
+
+struct Kernels;
+
+// Instruction sets the intersection kernels are available for, in
+// increasing order of width.
+enum class SimdLevel
+{
+    SCALAR,
+    SSE2,       // 2 doubles or 4 floats per instruction (see real.h)
+    AVX2        // 4 doubles or 8 floats per instruction
+};
+
+// widest level supported by both the cpu and the build
+SimdLevel detectSimdLevel();
+
+// Level used by kernels(). Defaults to detectSimdLevel(); requests above
+// it are lowered to it. Returns the level that is used from now on.
+SimdLevel setSimdLevel(SimdLevel requested);
+SimdLevel simdLevel();
+
+// kernels of the current level
+Kernels const &kernels();
+
+char const *simdLevelName(SimdLevel level);
+bool parseSimdLevel(std::string const &name, SimdLevel &level);
+
+#endif
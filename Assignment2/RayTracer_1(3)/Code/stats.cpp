@@ -0,0 +1,174 @@
+#include "stats.h"
+
+#include <iostream>
+#include <memory>
+#include <mutex>
+
+using namespace std;
+
+namespace
+{
+    char const *const NAMES[Stats::NUM_COUNTERS] =
+    {
+        "primaryRays",
+        "secondaryRays",
+        "secondaryRaysCut",
+        "packets",
+        "bvhTraversals",
+        "bvhPacketTraversals",
+        "bvhOcclusionTraversals",
+        "bvhNodes",
+        "bvhLeafPrimitives",
+        "sphereTests",
+        "triangleTests",
+        "quadTests",
+        "cylinderTests",
+        "meshTests",
+        "meshTriangleTests",
+        "hits",
+        "lightSamples",
+        "shadowRays",
+        "shadowRaysBlocked",
+        "shadowCacheHits",
+        "tiles"
+    };
+
+#ifdef RAY_STATS
+    // The blocks are owned here, one per worker index, and outlive the
+    // threads that filled them, so they can be summed after the threads
+    // have finished. They are allocated one by one, so a block never moves
+    // while a thread counts in it.
+    mutex blocksLock;
+    vector<unique_ptr<Stats::Block>> blocks;
+#endif
+}
+
+unsigned long long Stats::Block::operator[](Counter counter) const
+{
+    return counters[counter];
+}
+
+Stats::Block &Stats::Block::operator+=(Block const &other)
+{
+    for (unsigned idx = 0; idx != NUM_COUNTERS; ++idx)
+        counters[idx] += other.counters[idx];
+    busyMs += other.busyMs;
+    return *this;
+}
+
+#ifdef RAY_STATS
+
+Stats::BusyTimer::BusyTimer()
+:
+    d_start(chrono::steady_clock::now())
+{}
+
+Stats::BusyTimer::~BusyTimer()
+{
+    local().busyMs += chrono::duration<double, milli>(
+                        chrono::steady_clock::now() - d_start).count();
+}
+
+thread_local Stats::Block *Stats::s_local = Stats::block(0);
+
+Stats::Block *Stats::block(unsigned index)
+{
+    lock_guard<mutex> guard(blocksLock);
+    while (blocks.size() <= index)
+        blocks.emplace_back(new Block());
+    return blocks[index].get();
+}
+
+Stats::Worker::Worker(unsigned index)
+:
+    d_previous(s_local)
+{
+    s_local = block(index);
+}
+
+Stats::Worker::~Worker()
+{
+    s_local = d_previous;
+}
+
+#endif
+
+bool Stats::enabled()
+{
+#ifdef RAY_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Stats::reset()
+{
+#ifdef RAY_STATS
+    lock_guard<mutex> guard(blocksLock);
+    for (auto const &block : blocks)
+        *block = Block();
+#endif
+}
+
+Stats::Block Stats::total()
+{
+    Block sum;
+#ifdef RAY_STATS
+    lock_guard<mutex> guard(blocksLock);
+    for (auto const &block : blocks)
+        sum += *block;
+#endif
+    return sum;
+}
+
+vector<Stats::Block> Stats::perThread()
+{
+    vector<Block> result;
+#ifdef RAY_STATS
+    lock_guard<mutex> guard(blocksLock);
+    for (auto const &block : blocks)
+        if (block->counters[TILES] != 0)
+            result.push_back(*block);
+#endif
+    return result;
+}
+
+char const *Stats::name(Counter counter)
+{
+    return NAMES[counter];
+}
+
+// --- IO Operators ------------------------------------------------------------
+
+ostream &operator<<(ostream &os, Stats::Block const &block)
+{
+    // per ray, the averages that matter when comparing acceleration
+    // structures
+    unsigned long long rays = block[Stats::PRIMARY_RAYS];
+    unsigned long long traversals = block[Stats::BVH_TRAVERSALS]
+                                    + block[Stats::BVH_PACKET_TRAVERSALS]
+                                    + block[Stats::BVH_OCCLUSION_TRAVERSALS];
+    double perTraversal = traversals ? 1.0 / traversals : 0;
+    os << rays << " primary rays (" << block[Stats::PACKETS]
+       << " packets), " << block[Stats::HITS] << " hits, "
+       << block[Stats::LIGHT_SAMPLES] << " light samples\n"
+       << "  Secondary: " << block[Stats::SECONDARY_RAYS] << " rays, "
+       << block[Stats::SECONDARY_RAYS_CUT] << " cut off\n"
+       << "  BVH: " << block[Stats::BVH_TRAVERSALS] << " single ray, "
+       << block[Stats::BVH_PACKET_TRAVERSALS] << " packet and "
+       << block[Stats::BVH_OCCLUSION_TRAVERSALS] << " occlusion traversals, "
+       << block[Stats::BVH_NODES] * perTraversal << " nodes and "
+       << block[Stats::BVH_LEAF_PRIMITIVES] * perTraversal
+       << " primitives per traversal\n"
+       << "  Shadows: " << block[Stats::SHADOW_RAYS] << " rays, "
+       << block[Stats::SHADOW_RAYS_BLOCKED] << " blocked ("
+       << block[Stats::SHADOW_CACHE_HITS] << " by the cached occluder)\n"
+       << "  Tests: " << block[Stats::SPHERE_TESTS] << " sphere, "
+       << block[Stats::TRIANGLE_TESTS] << " triangle, "
+       << block[Stats::QUAD_TESTS] << " quad, "
+       << block[Stats::CYLINDER_TESTS] << " cylinder, "
+       << block[Stats::MESH_TESTS] << " mesh ("
+       << block[Stats::MESH_TRIANGLE_TESTS] << " mesh triangle)";
+    return os;
+}
@@ -0,0 +1,132 @@
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <chrono>
+#include <iosfwd>
+#include <vector>
+
+// Event counters for the hot paths of the ray tracer: rays, intersection
+// tests per primitive type, BVH nodes, hits and shading. Every worker of the
+// TileScheduler counts in its own block (a plain increment, no atomics or
+// shared cache lines); the blocks are summed when the statistics are read
+// after rendering. A block belongs to a worker index, not to a thread, so
+// the renders of several TileScheduler::run() calls add up per worker.
+// Threads that are not a worker count in the block of worker 0, which is
+// the thread that calls run().
+//
+// The counters only exist when RAY_STATS is defined (CMake option
+// RAY_STATS, on by default). Without it STATS_ADD and STATS_INC expand to
+// nothing, BusyTimer is empty and all counters read as zero.
+class Stats
+{
+    public:
+        enum Counter
+        {
+            PRIMARY_RAYS,
+            SECONDARY_RAYS,         // reflected and refracted rays traced
+            SECONDARY_RAYS_CUT,     // not traced: too little contribution
+            PACKETS,                // primary ray packets traced together
+            BVH_TRAVERSALS,         // single ray traversals
+            BVH_PACKET_TRAVERSALS,
+            BVH_OCCLUSION_TRAVERSALS,   // any-hit traversals of shadow rays
+            BVH_NODES,              // nodes visited
+            BVH_LEAF_PRIMITIVES,    // primitives in the leaves reached
+            SPHERE_TESTS,           // ray - primitive tests, per ray
+            TRIANGLE_TESTS,
+            QUAD_TESTS,             // also counted as two triangle tests
+            CYLINDER_TESTS,
+            MESH_TESTS,             // rays tested against a whole mesh
+            MESH_TRIANGLE_TESTS,    // rays tested against mesh triangles
+            HITS,                   // rays that hit an object
+            LIGHT_SAMPLES,          // light contributions evaluated
+            SHADOW_RAYS,
+            SHADOW_RAYS_BLOCKED,
+            SHADOW_CACHE_HITS,      // blocked by the light's last occluder
+            TILES,
+            NUM_COUNTERS
+        };
+
+        // Counters of one worker, on cache lines of its own
+        struct alignas(64) Block
+        {
+            unsigned long long counters[NUM_COUNTERS] = {};
+            double busyMs = 0.0;    // time spent rendering tiles
+
+            unsigned long long operator[](Counter counter) const;
+            Block &operator+=(Block const &other);
+        };
+
+        // Makes the current thread count in the block of worker index for
+        // its lifetime
+        class Worker
+        {
+#ifdef RAY_STATS
+            Block *d_previous;
+
+            public:
+                explicit Worker(unsigned index);
+                ~Worker();
+
+                Worker(Worker const &) = delete;
+                Worker &operator=(Worker const &) = delete;
+#else
+            public:
+                explicit Worker(unsigned) {}
+#endif
+        };
+
+        // Adds its lifetime to the busy time of the current worker
+        class BusyTimer
+        {
+#ifdef RAY_STATS
+            std::chrono::steady_clock::time_point d_start;
+
+            public:
+                BusyTimer();
+                ~BusyTimer();
+#else
+            public:
+                BusyTimer() {}
+#endif
+        };
+
+        static bool enabled();      // compiled with RAY_STATS
+
+        static void reset();
+        static Block total();
+        static std::vector<Block> perThread();   // workers that rendered
+
+        static char const *name(Counter counter);
+
+#ifdef RAY_STATS
+        // the block of the current worker
+        static Block &local();
+
+    private:
+        static thread_local Block *s_local;
+
+        static Block *block(unsigned index);    // created on first use
+#endif
+};
+
+std::ostream &operator<<(std::ostream &os, Stats::Block const &block);
+
+#ifdef RAY_STATS
+
+inline Stats::Block &Stats::local()
+{
+    return *s_local;
+}
+
+#define STATS_ADD(counter, count) \
+    (Stats::local().counters[Stats::counter] += (count))
+
+#else
+
+#define STATS_ADD(counter, count) static_cast<void>(sizeof(count))
+
+#endif
+
+#define STATS_INC(counter) STATS_ADD(counter, 1)
+
+#endif
@@ -0,0 +1,204 @@
+#include "texture.h"
+
+#include "half.h"
+#include "image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+namespace
+{
+    // s modulo 1, in [0, 1) (also for values just below a whole number,
+    // which round to 1, and for NaN, which becomes 0)
+    double repeat(double s)
+    {
+        s -= floor(s);
+        return s >= 0 && s < 1 ? s : 0.0;
+    }
+
+    uint32_t toByte(double value)
+    {
+        return uint32_t(lround(min(max(value, 0.0), 1.0) * 255.0));
+    }
+}
+
+Texture::Texture(Image const &image, Format format)
+:
+    d_format(format)
+{
+    unsigned width = max(image.width(), 1U);
+    unsigned height = max(image.height(), 1U);
+    vector<Color> pixels(size_t(width) * height);
+    for (unsigned y = 0; y != image.height(); ++y)
+        for (unsigned x = 0; x != image.width(); ++x)
+            pixels[size_t(y) * width + x] = image(x, y);
+    store(pixels, width, height);
+
+    // Every level averages 2 x 2 pixels of the previous one (an odd last
+    // row or column is dropped), down to a single pixel
+    while (width > 1 || height > 1)
+    {
+        unsigned const nextWidth = max(width / 2, 1U);
+        unsigned const nextHeight = max(height / 2, 1U);
+        vector<Color> next(size_t(nextWidth) * nextHeight);
+        for (unsigned y = 0; y != nextHeight; ++y)
+        {
+            unsigned const y0 = min(2 * y, height - 1);
+            unsigned const y1 = min(2 * y + 1, height - 1);
+            for (unsigned x = 0; x != nextWidth; ++x)
+            {
+                unsigned const x0 = min(2 * x, width - 1);
+                unsigned const x1 = min(2 * x + 1, width - 1);
+                next[size_t(y) * nextWidth + x] =
+                    0.25 * (pixels[size_t(y0) * width + x0]
+                            + pixels[size_t(y0) * width + x1]
+                            + pixels[size_t(y1) * width + x0]
+                            + pixels[size_t(y1) * width + x1]);
+            }
+        }
+        pixels.swap(next);
+        width = nextWidth;
+        height = nextHeight;
+        store(pixels, width, height);
+    }
+}
+
+size_t Texture::memoryUsage() const
+{
+    return d_rgba8.size() * sizeof(uint32_t)
+         + d_half.size() * sizeof(uint64_t);
+}
+
+Color Texture::sample(double s, double t, double lod, Filter filter) const
+{
+    unsigned const last = numLevels() - 1;
+    if (!(lod > 0))                         // also NaN
+        lod = 0;
+    if (lod >= last)
+        return bilinear(last, s, t);
+
+    if (filter == BILINEAR)
+        return bilinear(unsigned(lod + 0.5), s, t);
+
+    unsigned const level = unsigned(lod);
+    double const blend = lod - level;
+    Color color = bilinear(level, s, t);
+    if (blend > 0)
+        color = (1 - blend) * color + blend * bilinear(level + 1, s, t);
+    return color;
+}
+
+double Texture::lod(double size) const
+{
+    if (!(size > 0))
+        return 0.0;
+    return log2(size * sqrt(double(width()) * height()));
+}
+
+Color Texture::texel(unsigned level, unsigned x, unsigned y) const
+{
+    size_t const idx = address(d_levels[level], x, y);
+    if (d_format == RGBA8)
+    {
+        uint32_t const rgb = d_rgba8[idx];
+        return Color((rgb & 0xff) / 255.0, (rgb >> 8 & 0xff) / 255.0,
+                     (rgb >> 16 & 0xff) / 255.0);
+    }
+
+    uint64_t const rgb = d_half[idx];
+    return Color(halfToFloat(rgb & 0xffff), halfToFloat(rgb >> 16 & 0xffff),
+                 halfToFloat(rgb >> 32 & 0xffff));
+}
+
+// --- Private -----------------------------------------------------------------
+
+Color Texture::bilinear(unsigned level, double s, double t) const
+{
+    Level const &lv = d_levels[level];
+
+    // texel (x, y) covers [x, x + 1) x [y, y + 1), rows from the top
+    double const x = repeat(s) * lv.width - 0.5;
+    double const y = (1 - repeat(t)) * lv.height - 0.5;
+    double const fx = floor(x);
+    double const fy = floor(y);
+    double const wx = x - fx;
+    double const wy = y - fy;
+
+    unsigned const x0 = fx < 0 ? lv.width - 1 : unsigned(fx);
+    unsigned const y0 = fy < 0 ? lv.height - 1 : unsigned(fy);
+    unsigned const x1 = x0 + 1 == lv.width ? 0 : x0 + 1;
+    unsigned const y1 = y0 + 1 == lv.height ? 0 : y0 + 1;
+
+    return (1 - wy) * ((1 - wx) * texel(level, x0, y0)
+                       + wx * texel(level, x1, y0))
+           + wy * ((1 - wx) * texel(level, x0, y1)
+                   + wx * texel(level, x1, y1));
+}
+
+void Texture::store(vector<Color> const &pixels, unsigned width,
+                    unsigned height)
+{
+    Level level;
+    level.width = width;
+    level.height = height;
+    level.blocksPerRow = (width + 3) / 4;
+    level.offset = d_format == RGBA8 ? d_rgba8.size() : d_half.size();
+    d_levels.push_back(level);
+
+    // whole blocks, the texels beyond the edges are never read
+    size_t const size = level.offset
+                        + size_t(level.blocksPerRow) * ((height + 3) / 4) * 16;
+    if (d_format == RGBA8)
+        d_rgba8.resize(size);
+    else
+        d_half.resize(size);
+
+    for (unsigned y = 0; y != height; ++y)
+    {
+        for (unsigned x = 0; x != width; ++x)
+        {
+            Color const &pixel = pixels[size_t(y) * width + x];
+            size_t const idx = address(level, x, y);
+            if (d_format == RGBA8)
+                d_rgba8[idx] = toByte(pixel.r) | toByte(pixel.g) << 8
+                               | toByte(pixel.b) << 16;
+            else
+                d_half[idx] = uint64_t(floatToHalf(pixel.r))
+                              | uint64_t(floatToHalf(pixel.g)) << 16
+                              | uint64_t(floatToHalf(pixel.b)) << 32;
+        }
+    }
+}
+
+// --- TextureCache ------------------------------------------------------------
+
+TextureCache::TextureCache(Texture::Format format)
+:
+    d_format(format)
+{}
+
+shared_ptr<Texture const> TextureCache::load(string const &filename)
+{
+    auto found = d_textures.find(filename);
+    if (found != d_textures.end())
+        return found->second;
+
+    Image image;
+    image.read_png(filename);
+    shared_ptr<Texture const> texture =
+        make_shared<Texture const>(image, d_format);
+    d_textures.emplace(filename, texture);
+
+    cout << "Loaded texture: " << filename << " (" << texture->width()
+         << " x " << texture->height() << ", " << texture->numLevels()
+         << " levels, " << texture->memoryUsage() / 1024 << " KB).\n";
+    return texture;
+}
+
+size_t TextureCache::size() const
+{
+    return d_textures.size();
+}
@@ -0,0 +1,128 @@
+#ifndef TEXTURE_H_
+#define TEXTURE_H_
+
+#include "triple.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Image;
+
+// An image mapped onto surfaces, stored as a mip chain: the image and
+// versions of it halved in size down to 1 x 1 pixel, each averaging 2 x 2
+// pixels of the previous one. Sampling a level whose pixels are about as
+// large as the footprint of a ray avoids the noise of sampling a detailed
+// image sparsely.
+//
+// Every level is stored in blocks of 4 x 4 texels, block after block, so
+// the texels around a sample (and those of the next samples, which are
+// usually close by) share a few cache lines. A texel takes 8 bits per
+// channel (RGBA8) or a half float per channel (HALF, twice the memory,
+// without banding in the averaged levels).
+//
+// Texture coordinates (s, t) in [0, 1) cover the image once, with t = 0 at
+// its bottom row; the image repeats outside.
+class Texture
+{
+    public:
+        enum Format
+        {
+            RGBA8,
+            HALF
+        };
+
+        enum Filter
+        {
+            BILINEAR,           // bilinear within the nearest level
+            TRILINEAR           // and blended between two levels
+        };
+
+    private:
+        struct Level
+        {
+            unsigned width;
+            unsigned height;
+            unsigned blocksPerRow;
+            size_t offset;      // of its first texel in d_rgba8 / d_half
+        };
+
+        Format d_format;
+        std::vector<Level> d_levels;
+        std::vector<uint32_t> d_rgba8;      // r | g << 8 | b << 16
+        std::vector<uint64_t> d_half;       // r | g << 16 | b << 32
+
+    public:
+        explicit Texture(Image const &image, Format format = RGBA8);
+
+        unsigned width() const;             // of level 0
+        unsigned height() const;
+        unsigned numLevels() const;
+        Format format() const;
+        size_t memoryUsage() const;         // in bytes
+
+        // The color at (s, t) filtered over level lod, a fraction blends
+        // two levels with TRILINEAR. Levels beyond the last are clamped.
+        Color sample(double s, double t, double lod,
+                     Filter filter = TRILINEAR) const;
+
+        // The level of detail for a footprint of size texture lengths:
+        // log2 of its size in texels of level 0
+        double lod(double size) const;
+
+        Color texel(unsigned level, unsigned x, unsigned y) const;
+
+    private:
+        Color bilinear(unsigned level, double s, double t) const;
+        size_t address(Level const &level, unsigned x, unsigned y) const;
+        void store(std::vector<Color> const &pixels, unsigned width,
+                   unsigned height);
+};
+
+// Loads every texture file once, however many materials refer to it.
+class TextureCache
+{
+    Texture::Format d_format;
+    std::map<std::string, std::shared_ptr<Texture const>> d_textures;
+
+    public:
+        explicit TextureCache(Texture::Format format = Texture::RGBA8);
+
+        // The texture of a PNG file, loaded when it is first asked for.
+        // Throws runtime_error if the file cannot be read.
+        std::shared_ptr<Texture const> load(std::string const &filename);
+
+        size_t size() const;                // number of textures loaded
+};
+
+inline unsigned Texture::width() const
+{
+    return d_levels.front().width;
+}
+
+inline unsigned Texture::height() const
+{
+    return d_levels.front().height;
+}
+
+inline unsigned Texture::numLevels() const
+{
+    return d_levels.size();
+}
+
+inline Texture::Format Texture::format() const
+{
+    return d_format;
+}
+
+inline size_t Texture::address(Level const &level, unsigned x,
+                               unsigned y) const
+{
+    return level.offset + ((y >> 2) * level.blocksPerRow + (x >> 2)) * 16
+           + (y & 3) * 4 + (x & 3);
+}
+
+#endif
@@ -0,0 +1,135 @@
+#include "tilescheduler.h"
+
+#include "stats.h"
+
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+namespace
+{
+    // Tile indices owned by one worker. The owner pops from the front,
+    // thieves take from the back so they disturb the owner's locality least.
+    struct WorkQueue
+    {
+        mutex lock;
+        deque<unsigned> tiles;
+
+        bool popFront(unsigned &tile)
+        {
+            lock_guard<mutex> guard(lock);
+            if (tiles.empty())
+                return false;
+            tile = tiles.front();
+            tiles.pop_front();
+            return true;
+        }
+
+        bool popBack(unsigned &tile)
+        {
+            lock_guard<mutex> guard(lock);
+            if (tiles.empty())
+                return false;
+            tile = tiles.back();
+            tiles.pop_back();
+            return true;
+        }
+    };
+}
+
+TileScheduler::TileScheduler(unsigned width, unsigned height,
+                             unsigned tileSize, unsigned numThreads)
+:
+    d_numThreads(numThreads == 0 ? defaultThreadCount() : numThreads)
+{
+    tileSize = max(tileSize, 1U);
+    for (unsigned y = 0; y < height; y += tileSize)
+        for (unsigned x = 0; x < width; x += tileSize)
+            d_tiles.push_back(Tile{x, y, min(x + tileSize, width),
+                                         min(y + tileSize, height)});
+
+    // no use in starting threads that can never get a tile
+    d_numThreads = max(1U, min<unsigned>(d_numThreads, d_tiles.size()));
+}
+
+void TileScheduler::run(function<void(Tile const &, unsigned)> const
+                            &renderTile) const
+{
+    if (d_numThreads == 1)
+    {
+        Stats::Worker stats(0);
+        for (Tile const &tile : d_tiles)
+            renderTile(tile, 0);
+        return;
+    }
+
+    // Hand out contiguous ranges of tiles so each thread starts with
+    // neighbouring (coherent) work.
+    vector<WorkQueue> queues(d_numThreads);
+    size_t const count = d_tiles.size();
+    for (unsigned thr = 0; thr != d_numThreads; ++thr)
+        for (size_t idx = count * thr / d_numThreads;
+             idx != count * (thr + 1) / d_numThreads; ++idx)
+            queues[thr].tiles.push_back(idx);
+
+    mutex errorLock;
+    exception_ptr error;
+
+    auto worker = [&](unsigned self)
+    {
+        Stats::Worker stats(self);
+        try
+        {
+            unsigned tile;
+            while (true)
+            {
+                bool found = queues[self].popFront(tile);
+                for (unsigned off = 1; !found && off != d_numThreads; ++off)
+                    found = queues[(self + off) % d_numThreads].popBack(tile);
+
+                if (!found)     // every queue is empty: all work handed out
+                    return;
+
+                renderTile(d_tiles[tile], self);
+            }
+        }
+        catch (...)
+        {
+            lock_guard<mutex> guard(errorLock);
+            if (!error)
+                error = current_exception();
+        }
+    };
+
+    // the calling thread is worker 0
+    vector<thread> threads;
+    threads.reserve(d_numThreads - 1);
+    for (unsigned thr = 1; thr != d_numThreads; ++thr)
+        threads.emplace_back(worker, thr);
+    worker(0);
+
+    for (thread &thr : threads)
+        thr.join();
+
+    if (error)
+        rethrow_exception(error);
+}
+
+unsigned TileScheduler::numTiles() const
+{
+    return d_tiles.size();
+}
+
+unsigned TileScheduler::numThreads() const
+{
+    return d_numThreads;
+}
+
+unsigned TileScheduler::defaultThreadCount()
+{
+    return max(1U, thread::hardware_concurrency());
+}
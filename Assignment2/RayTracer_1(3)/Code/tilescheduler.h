@@ -0,0 +1,43 @@
+#ifndef TILESCHEDULER_H_
+#define TILESCHEDULER_H_
+
+#include <functional>
+#include <vector>
+
+// A rectangular block of pixels: [x0, x1) x [y0, y1)
+struct Tile
+{
+    unsigned x0;
+    unsigned y0;
+    unsigned x1;
+    unsigned y1;
+};
+
+// Splits an image into tiles and renders them on a pool of threads.
+// Every thread starts with a contiguous range of tiles and steals from
+// the back of the other threads' queues once its own queue runs dry.
+// Tiles never overlap, so the result does not depend on which thread
+// renders which tile.
+class TileScheduler
+{
+    std::vector<Tile> d_tiles;
+    unsigned d_numThreads;
+
+    public:
+        TileScheduler(unsigned width, unsigned height,
+                      unsigned tileSize, unsigned numThreads);
+
+        // Calls renderTile once for every tile with the index of the thread
+        // that renders it (below numThreads()), returns when all are done.
+        // The thread counts its statistics (see stats.h) under that index.
+        void run(std::function<void(Tile const &, unsigned)> const
+                     &renderTile) const;
+
+        unsigned numTiles() const;
+        unsigned numThreads() const;
+
+        // number of threads to use when none is specified
+        static unsigned defaultThreadCount();
+};
+
+#endif
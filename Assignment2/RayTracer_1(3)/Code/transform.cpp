@@ -0,0 +1,67 @@
+#include "transform.h"
+
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+Transform::Transform()
+:
+    d_m{ { 1, 0, 0, 0 },
+         { 0, 1, 0, 0 },
+         { 0, 0, 1, 0 } }
+{}
+
+Transform::Transform(Vector const &x, Vector const &y, Vector const &z,
+                     Point const &translation)
+{
+    for (unsigned row = 0; row != 3; ++row)
+    {
+        d_m[row][0] = x.data[row];
+        d_m[row][1] = y.data[row];
+        d_m[row][2] = z.data[row];
+        d_m[row][3] = translation.data[row];
+    }
+}
+
+Transform::Transform(double const (&rows)[3][4])
+{
+    for (unsigned row = 0; row != 3; ++row)
+        for (unsigned col = 0; col != 4; ++col)
+            d_m[row][col] = rows[row][col];
+}
+
+Transform Transform::inverse() const
+{
+    // the inverse of L is its adjugate (the transposed cofactors) over its
+    // determinant
+    double const (&m)[3][4] = d_m;
+    double cofactor[3][3];
+    for (unsigned row = 0; row != 3; ++row)
+    {
+        unsigned const r1 = (row + 1) % 3;
+        unsigned const r2 = (row + 2) % 3;
+        for (unsigned col = 0; col != 3; ++col)
+        {
+            unsigned const c1 = (col + 1) % 3;
+            unsigned const c2 = (col + 2) % 3;
+            cofactor[row][col] = m[r1][c1] * m[r2][c2] - m[r1][c2] * m[r2][c1];
+        }
+    }
+
+    double const det = m[0][0] * cofactor[0][0] + m[0][1] * cofactor[0][1]
+                       + m[0][2] * cofactor[0][2];
+    if (det == 0 || !isfinite(det))
+        throw runtime_error("Transform cannot be inverted.");
+
+    // L^-1 p - L^-1 t
+    double rows[3][4];
+    for (unsigned row = 0; row != 3; ++row)
+    {
+        for (unsigned col = 0; col != 3; ++col)
+            rows[row][col] = cofactor[col][row] / det;
+        rows[row][3] = -(rows[row][0] * m[0][3] + rows[row][1] * m[1][3]
+                         + rows[row][2] * m[2][3]);
+    }
+    return Transform(rows);
+}
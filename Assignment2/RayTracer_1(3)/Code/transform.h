@@ -0,0 +1,61 @@
+#ifndef TRANSFORM_H_
+#define TRANSFORM_H_
+
+#include "triple.h"
+
+// Affine transformation stored as a 4x3 matrix: a linear part L (the first
+// three columns) and a translation t (the last column), mapping p to
+// L p + t. Places the instances of a mesh: its geometry is stored once in
+// model space, and every instance maps it into the scene with its own
+// transform. Computed in double precision, also when real is float.
+class Transform
+{
+    double d_m[3][4];       // row-major
+
+    public:
+        Transform();        // identity
+
+        // the transform mapping the x, y and z axes to x, y and z, and the
+        // origin to translation
+        Transform(Vector const &x, Vector const &y, Vector const &z,
+                  Point const &translation);
+
+        // from the three rows of the matrix
+        explicit Transform(double const (&rows)[3][4]);
+
+        Point point(Point const &p) const;              // L p + t
+        Vector vector(Vector const &v) const;           // L v
+
+        // L^T v. Normals of a surface map opposite to its points: normal N
+        // in model space is toModel.transposed(N) in the scene.
+        Vector transposed(Vector const &v) const;
+
+        // Throws runtime_error if the linear part is singular
+        Transform inverse() const;
+};
+
+inline Point Transform::point(Point const &p) const
+{
+    return Point(d_m[0][0] * p.x + d_m[0][1] * p.y + d_m[0][2] * p.z
+                     + d_m[0][3],
+                 d_m[1][0] * p.x + d_m[1][1] * p.y + d_m[1][2] * p.z
+                     + d_m[1][3],
+                 d_m[2][0] * p.x + d_m[2][1] * p.y + d_m[2][2] * p.z
+                     + d_m[2][3]);
+}
+
+inline Vector Transform::vector(Vector const &v) const
+{
+    return Vector(d_m[0][0] * v.x + d_m[0][1] * v.y + d_m[0][2] * v.z,
+                  d_m[1][0] * v.x + d_m[1][1] * v.y + d_m[1][2] * v.z,
+                  d_m[2][0] * v.x + d_m[2][1] * v.y + d_m[2][2] * v.z);
+}
+
+inline Vector Transform::transposed(Vector const &v) const
+{
+    return Vector(d_m[0][0] * v.x + d_m[1][0] * v.y + d_m[2][0] * v.z,
+                  d_m[0][1] * v.x + d_m[1][1] * v.y + d_m[2][1] * v.z,
+                  d_m[0][2] * v.x + d_m[1][2] * v.y + d_m[2][2] * v.z);
+}
+
+#endif
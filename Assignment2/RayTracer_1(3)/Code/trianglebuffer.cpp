@@ -0,0 +1,121 @@
+#include "trianglebuffer.h"
+
+#include "simd.h"
+
+#include <utility>
+
+using namespace std;
+
+TriangleBuffer::TriangleBuffer(vector<Point> positions,
+                               vector<unsigned> indices)
+:
+    d_positions(move(positions)),
+    d_indices(move(indices))
+{
+    computeEdges();
+}
+
+size_t TriangleBuffer::size() const
+{
+    return d_indices.size() / 3;
+}
+
+size_t TriangleBuffer::memoryUsage() const
+{
+    return d_positions.size() * sizeof(Point)
+         + d_indices.size() * sizeof(unsigned)
+         + size() * 9 * sizeof(real);
+}
+
+BBox TriangleBuffer::bounds(unsigned tri) const
+{
+    BBox box;
+    for (unsigned corner = 0; corner != 3; ++corner)
+        box.extend(d_positions[d_indices[3 * tri + corner]]);
+    return box;
+}
+
+Vector TriangleBuffer::normal(unsigned tri) const
+{
+    Vector N = edge1(tri).cross(edge2(tri));
+    N.normalize();
+    return N;
+}
+
+double TriangleBuffer::area(unsigned tri) const
+{
+    return edge1(tri).cross(edge2(tri)).length() / 2;
+}
+
+Vector TriangleBuffer::edge1(unsigned tri) const
+{
+    return Vector(d_e1[0][tri], d_e1[1][tri], d_e1[2][tri]);
+}
+
+Vector TriangleBuffer::edge2(unsigned tri) const
+{
+    return Vector(d_e2[0][tri], d_e2[1][tri], d_e2[2][tri]);
+}
+
+void TriangleBuffer::reorder(vector<unsigned> const &order)
+{
+    vector<unsigned> indices;
+    indices.reserve(d_indices.size());
+    for (unsigned tri : order)
+        for (unsigned corner = 0; corner != 3; ++corner)
+            indices.push_back(d_indices[3 * tri + corner]);
+
+    d_indices.swap(indices);
+    computeEdges();
+}
+
+bool TriangleBuffer::intersect(Ray const &ray, unsigned first, unsigned count,
+                               double &tMax, unsigned &hitTri, double &u,
+                               double &v) const
+{
+    real t = tMax;
+    real hitU;
+    real hitV;
+    if (!kernels().intersectTriangles(ray.O.data, ray.D.data, arrays(),
+                                      first, count, t, hitTri, hitU, hitV))
+        return false;
+    tMax = t;
+    u = hitU;
+    v = hitV;
+    return true;
+}
+
+TriangleArrays TriangleBuffer::arrays() const
+{
+    return TriangleArrays{
+        { d_v0[0].data(), d_v0[1].data(), d_v0[2].data() },
+        { d_e1[0].data(), d_e1[1].data(), d_e1[2].data() },
+        { d_e2[0].data(), d_e2[1].data(), d_e2[2].data() }
+    };
+}
+
+// --- Private -----------------------------------------------------------------
+
+void TriangleBuffer::computeEdges()
+{
+    size_t const count = size();
+    for (unsigned axis = 0; axis != 3; ++axis)
+    {
+        d_v0[axis].resize(count);
+        d_e1[axis].resize(count);
+        d_e2[axis].resize(count);
+    }
+
+    for (size_t tri = 0; tri != count; ++tri)
+    {
+        Point const &v0 = d_positions[d_indices[3 * tri]];
+        Point const &v1 = d_positions[d_indices[3 * tri + 1]];
+        Point const &v2 = d_positions[d_indices[3 * tri + 2]];
+        for (unsigned axis = 0; axis != 3; ++axis)
+        {
+            d_v0[axis][tri] = v0.data[axis];
+            d_e1[axis][tri] = v1.data[axis] - v0.data[axis];
+            d_e2[axis][tri] = v2.data[axis] - v0.data[axis];
+        }
+    }
+}
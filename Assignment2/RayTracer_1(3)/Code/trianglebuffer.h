@@ -0,0 +1,73 @@
+#ifndef TRIANGLEBUFFER_H_
+#define TRIANGLEBUFFER_H_
+
+#include "bbox.h"
+#include "kernels.h"
+#include "ray.h"
+#include "triple.h"
+
+#include <cstddef>
+#include <vector>
+
+// Contiguous storage for many triangles. The geometry is kept as an indexed
+// vertex buffer (shared corners are stored once) next to the data needed by
+// the intersection test: the first corner and both edges of every triangle,
+// laid out as structure-of-arrays so a batch of triangles is read linearly.
+class TriangleBuffer
+{
+    std::vector<Point> d_positions;
+    std::vector<unsigned> d_indices;    // three positions per triangle
+
+    std::vector<real> d_v0[3];          // x, y and z of corner v0
+    std::vector<real> d_e1[3];          // edge v1 - v0
+    std::vector<real> d_e2[3];          // edge v2 - v0
+
+    public:
+        TriangleBuffer() = default;
+        TriangleBuffer(std::vector<Point> positions,
+                       std::vector<unsigned> indices);
+
+        size_t size() const;                // number of triangles
+        size_t memoryUsage() const;         // in bytes
+
+        BBox bounds(unsigned tri) const;
+        Vector normal(unsigned tri) const;  // unit normal, (v1-v0)x(v2-v0)
+        double area(unsigned tri) const;
+        Vector edge1(unsigned tri) const;   // v1 - v0
+        Vector edge2(unsigned tri) const;   // v2 - v0
+
+        std::vector<Point> const &positions() const;
+
+        // the indices of the positions of corners v0, v1 and v2
+        unsigned const *corners(unsigned tri) const;
+
+        // store triangle order[i] at position i
+        void reorder(std::vector<unsigned> const &order);
+
+        // Intersects triangles [first, first + count) with the ray, using the
+        // same Moller-Trumbore test as Triangle::intersect. If one of them
+        // is hit closer than tMax, tMax is lowered to its distance, its index
+        // is stored in hitTri, its barycentric coordinates in u and v, and
+        // true is returned. Runs the widest SIMD kernel enabled by
+        // setSimdLevel().
+        bool intersect(Ray const &ray, unsigned first, unsigned count,
+                       double &tMax, unsigned &hitTri, double &u,
+                       double &v) const;
+
+        TriangleArrays arrays() const;
+
+    private:
+        void computeEdges();
+};
+
+inline unsigned const *TriangleBuffer::corners(unsigned tri) const
+{
+    return &d_indices[3 * tri];
+}
+
+inline std::vector<Point> const &TriangleBuffer::positions() const
+{
+    return d_positions;
+}
+
+#endif
@@ -2,7 +2,9 @@
 #define TRIPLE_H_
 
 #include "json/json_fwd.h"
+#include "real.h"
 
+#include <cmath>
 #include <iosfwd>
 
 // Color, Point and Vector are all Triples (name them so)
@@ -11,6 +13,9 @@ typedef Triple Color;
 typedef Triple Point;
 typedef Triple Vector;
 
+// All arithmetic is defined inline below: it is on the hot path of every
+// intersection and shading computation, and inlined calls let the compiler
+// keep the members in registers.
 class Triple
 {
     public:
@@ -19,57 +24,62 @@ class Triple
         // union to acces the same elements by
         // x, y, z, or r, g, b or data[index]
         union {
-            double data[3];
+            real data[3];
             struct {
-                double x;
-                double y;
-                double z;
+                real x;
+                real y;
+                real z;
             };
             struct {
-                double r;
-                double g;
-                double b;
+                real r;
+                real g;
+                real b;
             };
         };
 
 // --- Constructors ------------------------------------------------------------
 
-        explicit Triple(double X = 0, double Y = 0, double Z = 0);
+        constexpr explicit Triple(real X = 0, real Y = 0, real Z = 0);
         explicit Triple(nlohmann::json const &node);    // json -> Triple
 
 // --- Operators ---------------------------------------------------------------
 
-        Triple operator+(Triple const &t) const;// add two triples
-        Triple operator+(double f) const;       // add a value to each member
-                                                // of a triple
-        Triple operator-() const;               // negate
-        Triple operator-(Triple const &t) const;// subtract two triples
-        Triple operator-(double f) const;       // subtract a value from each
-                                                // member
+        // add two triples
+        constexpr Triple operator+(Triple const &t) const;
+        // add a value to each member of a triple
+        constexpr Triple operator+(real f) const;
+        // negate
+        constexpr Triple operator-() const;
+        // subtract two triples
+        constexpr Triple operator-(Triple const &t) const;
+        // subtract a value from each member
+        constexpr Triple operator-(real f) const;
 
-        Triple operator*(Triple const &t) const;// memberwise multiplication
-        Triple operator*(double f) const;       // multiply each member with a
-                                                // value
-        Triple operator/(double f) const;       // divide each member by a value
+        // memberwise multiplication
+        constexpr Triple operator*(Triple const &t) const;
+        // multiply each member with a value
+        constexpr Triple operator*(real f) const;
+        // divide each member by a value
+        constexpr Triple operator/(real f) const;
 
 // --- Compound operators ------------------------------------------------------
 
-        Triple &operator+=(Triple const &t);
-        Triple &operator+=(double f);
+        constexpr Triple &operator+=(Triple const &t);
+        constexpr Triple &operator+=(real f);
 
-        Triple &operator-=(Triple const &t);
-        Triple &operator-=(double f);
+        constexpr Triple &operator-=(Triple const &t);
+        constexpr Triple &operator-=(real f);
 
-        Triple &operator*=(double f);
-        Triple &operator/=(double f);
+        constexpr Triple &operator*=(real f);
+        constexpr Triple &operator/=(real f);
 
 // --- Vector Operators --------------------------------------------------------
 
-        double dot(Triple const &t) const;      // dot product
-        Triple cross(Triple const &t) const;    // cross product
+        constexpr real dot(Triple const &t) const;      // dot product
+        constexpr Triple cross(Triple const &t) const;  // cross product
 
-        double length() const;
-        double length_2() const;                // length squared
+        real length() const;
+        constexpr real length_2() const;                // length squared
 
         // NOTE: normalized return a COPY, normalize does NOT
         Triple normalized() const;              // normalized COPY
@@ -77,24 +87,218 @@ class Triple
 
 // --- Color functions ---------------------------------------------------------
 
-        void set(double f);                     // set all values to f
-        void set(double f, double maxValue);    // set all values to f / maxVal
-        void set(double red, double green, double blue);
-        void set(double red, double green, double blue, double maxValue);
+        constexpr void set(real f);             // set all values to f
+        // set all values to f / maxVal
+        constexpr void set(real f, real maxValue);
+        constexpr void set(real red, real green, real blue);
+        constexpr void set(real red, real green, real blue, real maxValue);
 
-        void clamp(double maxValue = 1.0);      // clamp: fmin(val, maxValue)
+        void clamp(real maxValue = 1.0);        // clamp: fmin(val, maxValue)
 
 };
 
 // --- Free Operators ----------------------------------------------------------
 
-Triple operator+(double f, Triple const &t);
-Triple operator-(double f, Triple const &t);
-Triple operator*(double f, Triple const &t);
+constexpr Triple operator+(real f, Triple const &t);
+constexpr Triple operator-(real f, Triple const &t);
+constexpr Triple operator*(real f, Triple const &t);
 
 // --- IO Operators ------------------------------------------------------------
 
 std::istream &operator>>(std::istream &is, Triple &t);
 std::ostream &operator<<(std::ostream &os, Triple const &t);
 
+// --- Constructors ------------------------------------------------------------
+
+constexpr Triple::Triple(real X, real Y, real Z)
+:
+    x(X),
+    y(Y),
+    z(Z)
+{}
+
+// --- Operators ---------------------------------------------------------------
+
+constexpr Triple Triple::operator+(Triple const &t) const
+{
+    return Triple(x + t.x, y + t.y, z + t.z);
+}
+
+constexpr Triple Triple::operator+(real f) const
+{
+    return Triple(x + f, y + f, z + f);
+}
+
+constexpr Triple Triple::operator-() const
+{
+    return Triple(-x, -y, -z);
+}
+
+constexpr Triple Triple::operator-(Triple const &t) const
+{
+    return Triple(x - t.x, y - t.y, z - t.z);
+}
+
+constexpr Triple Triple::operator-(real f) const
+{
+    return Triple(x - f, y - f, z - f);
+}
+
+constexpr Triple Triple::operator*(Triple const &t) const
+{
+    return Triple(x * t.x, y * t.y, z * t.z);
+}
+
+constexpr Triple Triple::operator*(real f) const
+{
+    return Triple(x * f, y * f, z * f);
+}
+
+constexpr Triple Triple::operator/(real f) const
+{
+    real invf = 1.0 / f;
+    return Triple(x * invf, y * invf, z * invf);
+}
+
+// --- Compound operators ------------------------------------------------------
+
+constexpr Triple &Triple::operator+=(Triple const &t)
+{
+    x += t.x;
+    y += t.y;
+    z += t.z;
+    return *this;
+}
+
+constexpr Triple &Triple::operator+=(real f)
+{
+    x += f;
+    y += f;
+    z += f;
+    return *this;
+}
+
+constexpr Triple &Triple::operator-=(Triple const &t)
+{
+    x -= t.x;
+    y -= t.y;
+    z -= t.z;
+    return *this;
+}
+
+constexpr Triple &Triple::operator-=(real f)
+{
+    x -= f;
+    y -= f;
+    z -= f;
+    return *this;
+}
+
+constexpr Triple &Triple::operator*=(real f)
+{
+    x *= f;
+    y *= f;
+    z *= f;
+    return *this;
+}
+
+constexpr Triple &Triple::operator/=(real f)
+{
+    real invf = 1.0 / f;
+    x *= invf;
+    y *= invf;
+    z *= invf;
+    return *this;
+}
+
+// --- Vector Operators --------------------------------------------------------
+
+constexpr real Triple::dot(Triple const &t) const
+{
+    return x * t.x + y * t.y + z * t.z;
+}
+
+constexpr Triple Triple::cross(Triple const &t) const
+{
+    return Triple(y*t.z - z*t.y,
+                  z*t.x - x*t.z,
+                  x*t.y - y*t.x);
+}
+
+inline real Triple::length() const
+{
+    return std::sqrt(length_2());
+}
+
+constexpr real Triple::length_2() const
+{
+    return x * x + y * y + z * z;
+}
+
+inline Triple Triple::normalized() const
+{
+    return (*this) / length();
+}
+
+inline void Triple::normalize()
+{
+    real len = length();
+    real invlen = 1.0 / len;
+    x *= invlen;
+    y *= invlen;
+    z *= invlen;
+}
+
+// --- Color functions ---------------------------------------------------------
+
+constexpr void Triple::set(real f)
+{
+    r = f;
+    g = f;
+    b = f;
+}
+
+constexpr void Triple::set(real f, real maxValue)
+{
+    set(f / maxValue);
+}
+
+constexpr void Triple::set(real red, real green, real blue)
+{
+    r = red;
+    g = green;
+    b = blue;
+}
+
+constexpr void Triple::set(real red, real green, real blue, real maxValue)
+{
+    set(red / maxValue, green / maxValue, blue / maxValue);
+}
+
+inline void Triple::clamp(real maxValue)
+{
+    r = std::fmin(r, maxValue);
+    g = std::fmin(g, maxValue);
+    b = std::fmin(b, maxValue);
+}
+
+// --- Free Operators ----------------------------------------------------------
+
+// NOTE: no Triple:: needed!
+
+constexpr Triple operator+(real f, Triple const &t)
+{
+    return Triple(f + t.x, f + t.y, f + t.z);
+}
+
+constexpr Triple operator-(real f, Triple const &t)
+{
+    return Triple(f - t.x, f - t.y, f - t.z);
+}
+
+constexpr Triple operator*(real f, Triple const &t)
+{
+    return Triple(f * t.x, f * t.y, f * t.z);
+}
+
 #endif
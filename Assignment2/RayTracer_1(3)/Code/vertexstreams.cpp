@@ -0,0 +1,130 @@
+#include "vertexstreams.h"
+
+#include "half.h"
+
+#include <cmath>
+
+using namespace std;
+
+namespace
+{
+    // Octahedral encoding: the unit vector is projected onto the octahedron
+    // |x| + |y| + |z| = 1, whose lower half is folded over the upper half
+    // onto the square [-1, 1]^2. Both coordinates are stored as 16-bit
+    // signed normalized integers. A zero normal is stored as -32768 in
+    // both, which no unit vector encodes to.
+
+    double const OCT_SCALE = 32767.0;
+    uint32_t const OCT_ZERO = 0x80008000;
+
+    double signNotZero(double value)
+    {
+        return value < 0 ? -1.0 : 1.0;
+    }
+
+    uint32_t encodeOctahedral(Vector const &N)
+    {
+        double const norm = fabs(N.x) + fabs(N.y) + fabs(N.z);
+        if (!(norm > 0))
+            return OCT_ZERO;
+
+        double x = N.x / norm;
+        double y = N.y / norm;
+        if (N.z < 0)
+        {
+            double const foldedX = (1 - fabs(y)) * signNotZero(x);
+            y = (1 - fabs(x)) * signNotZero(y);
+            x = foldedX;
+        }
+
+        int16_t const qx = int16_t(lround(x * OCT_SCALE));
+        int16_t const qy = int16_t(lround(y * OCT_SCALE));
+        return uint32_t(uint16_t(qx)) | uint32_t(uint16_t(qy)) << 16;
+    }
+
+    Vector decodeOctahedral(uint32_t code)
+    {
+        if (code == OCT_ZERO)
+            return Vector(0, 0, 0);
+
+        double x = int16_t(code & 0xffff) / OCT_SCALE;
+        double y = int16_t(code >> 16) / OCT_SCALE;
+        double const z = 1 - fabs(x) - fabs(y);
+        if (z < 0)
+        {
+            double const unfoldedX = (1 - fabs(y)) * signNotZero(x);
+            y = (1 - fabs(x)) * signNotZero(y);
+            x = unfoldedX;
+        }
+        return Vector(x, y, z).normalized();
+    }
+}
+
+VertexStreams::VertexStreams(vector<Vector> const &normals,
+                             vector<float> const &texCoords, bool compact)
+:
+    d_compact(compact)
+{
+    if (!compact)
+    {
+        d_normals.reserve(normals.size());
+        for (Vector const &N : normals)
+            d_normals.push_back(N.length() > 0 ? N.normalized() : N);
+        d_texCoords = texCoords;
+        return;
+    }
+
+    d_octNormals.reserve(normals.size());
+    for (Vector const &N : normals)
+        d_octNormals.push_back(encodeOctahedral(N));
+
+    d_halfTexCoords.reserve(texCoords.size() / 2);
+    for (size_t idx = 0; idx + 1 < texCoords.size(); idx += 2)
+        d_halfTexCoords.push_back(
+            uint32_t(floatToHalf(texCoords[idx]))
+            | uint32_t(floatToHalf(texCoords[idx + 1])) << 16);
+}
+
+size_t VertexStreams::memoryUsage() const
+{
+    return d_normals.size() * sizeof(Vector)
+         + d_texCoords.size() * sizeof(float)
+         + d_octNormals.size() * sizeof(uint32_t)
+         + d_halfTexCoords.size() * sizeof(uint32_t);
+}
+
+Vector VertexStreams::normal(unsigned vertex) const
+{
+    return d_compact ? decodeOctahedral(d_octNormals[vertex])
+                     : d_normals[vertex];
+}
+
+TexCoord VertexStreams::texCoord(unsigned vertex) const
+{
+    if (!d_compact)
+        return TexCoord{ d_texCoords[2 * vertex],
+                         d_texCoords[2 * vertex + 1] };
+
+    uint32_t const code = d_halfTexCoords[vertex];
+    return TexCoord{ halfToFloat(code & 0xffff), halfToFloat(code >> 16) };
+}
+
+Vector VertexStreams::normal(unsigned const *corners, double u,
+                             double v) const
+{
+    Vector const N = (1 - u - v) * normal(corners[0])
+                     + u * normal(corners[1]) + v * normal(corners[2]);
+    double const length = N.length();
+    return length > 0 ? N / length : N;
+}
+
+TexCoord VertexStreams::texCoord(unsigned const *corners, double u,
+                                 double v) const
+{
+    TexCoord const c0 = texCoord(corners[0]);
+    TexCoord const c1 = texCoord(corners[1]);
+    TexCoord const c2 = texCoord(corners[2]);
+    double const w = 1 - u - v;
+    return TexCoord{ w * c0.s + u * c1.s + v * c2.s,
+                     w * c0.t + u * c1.t + v * c2.t };
+}
@@ -0,0 +1,62 @@
+#ifndef VERTEXSTREAMS_H_
+#define VERTEXSTREAMS_H_
+
+#include "hit.h"
+#include "triple.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The normals and texture coordinates of the vertices of a mesh, each an
+// optional stream indexed like the vertex positions of its TriangleBuffer,
+// and interpolated across the triangles with the barycentric coordinates
+// of a Hit.
+//
+// Compact streams store a normal as two 16-bit octahedral coordinates (the
+// unit sphere folded onto a square) and texture coordinates as two half
+// floats: 4 bytes per vertex each, instead of 3 reals and 2 floats. A compact
+// normal is within 0.004 degrees of the original (a zero normal stays
+// zero), a texture coordinate in [0, 1] within 1/4096.
+class VertexStreams
+{
+    bool d_compact = false;
+    std::vector<Vector> d_normals;
+    std::vector<float> d_texCoords;         // s, t per vertex
+    std::vector<uint32_t> d_octNormals;     // compact normals
+    std::vector<uint32_t> d_halfTexCoords;  // compact texture coordinates
+
+    public:
+        VertexStreams() = default;
+
+        // normals: one per vertex or none, need not be unit length,
+        // texCoords: s and t per vertex or none
+        VertexStreams(std::vector<Vector> const &normals,
+                      std::vector<float> const &texCoords,
+                      bool compact = false);
+
+        bool hasNormals() const;
+        bool hasTexCoords() const;
+        size_t memoryUsage() const;         // in bytes
+
+        Vector normal(unsigned vertex) const;       // unit length or zero
+        TexCoord texCoord(unsigned vertex) const;
+
+        // Interpolated at the point (1 - u - v) c0 + u c1 + v c2 of the
+        // triangle with vertices corners[0, 1, 2]. The normal is unit
+        // length, or zero where the vertex normals cancel out.
+        Vector normal(unsigned const *corners, double u, double v) const;
+        TexCoord texCoord(unsigned const *corners, double u, double v) const;
+};
+
+inline bool VertexStreams::hasNormals() const
+{
+    return !d_normals.empty() || !d_octNormals.empty();
+}
+
+inline bool VertexStreams::hasTexCoords() const
+{
+    return !d_texCoords.empty() || !d_halfTexCoords.empty();
+}
+
+#endif